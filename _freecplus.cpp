@@ -266,7 +266,7 @@ void UpdateStr(char *str,const char *str1,const char *str2,bool bloop)
   if ( (str1 == 0) || (str2 == 0) ) return;
 
   // 如果bloop为true并且str2中包函了str1的内容，直接返回，因为会进入死循环，最终导致内存溢出。
-  if ( (bloop==true) && (strstr(str2,str1)>0) ) return;
+  if ( (bloop==true) && (strstr(str2,str1)!=0) ) return;
 
   // 尽可能分配更多的空间，但仍有可能出现内存溢出的情况，最好优化成string。
   int ilen=strlen(str)*10;
@@ -993,7 +993,8 @@ void timetostr(const time_t ltime,char *stime,const char *fmt)
 
   strcpy(stime,"");
 
-  struct tm sttm = *localtime ( &ltime ); 
+  // 日志由多个线程同时写入，用可重入的localtime_r。
+  struct tm sttm; localtime_r(&ltime,&sttm);
 
   sttm.tm_year=sttm.tm_year+1900;
   sttm.tm_mon++;
@@ -1131,23 +1132,29 @@ void LocalTime(char *stime,const char *fmt,const int timetvl)
 CLogFile::CLogFile(const long MaxLogSize)
 {
   m_tracefp = 0;
+  m_sink = 0;
+  m_nLogSize = 0;
   memset(m_filename,0,sizeof(m_filename));
   memset(m_openmode,0,sizeof(m_openmode));
   m_bBackup=true;
   m_bEnBuffer=false;
   m_MaxLogSize=MaxLogSize;
   if (m_MaxLogSize<10) m_MaxLogSize=10;
+  pthread_mutex_init(&m_mutex,0);
 }
 
 CLogFile::~CLogFile()
 {
   Close();
+  pthread_mutex_destroy(&m_mutex);
 }
 
 void CLogFile::Close()
 {
   if (m_tracefp != 0) { fclose(m_tracefp); m_tracefp=0; }
 
+  m_sink=0;
+
   memset(m_filename,0,sizeof(m_filename));
   memset(m_openmode,0,sizeof(m_openmode));
   m_bBackup=true;
@@ -1172,6 +1179,10 @@ bool CLogFile::Open(const char *filename,const char *openmode,bool bBackup,bool
 
   if ((m_tracefp=FOPEN(m_filename,m_openmode)) == 0) return false;
 
+  // 只在打开时读取一次文件大小，之后在内存中累计。
+  fseek(m_tracefp,0L,2);
+  m_nLogSize=ftell(m_tracefp);
+
   return true;
 }
 
@@ -1185,9 +1196,7 @@ bool CLogFile::BackupLogFile()
   // 不备份
   if (m_bBackup == false) return true;
 
-  fseek(m_tracefp,0L,2);
-
-  if (ftell(m_tracefp) > m_MaxLogSize*1024*1024)
+  if (m_nLogSize > m_MaxLogSize*1024*1024)
   {
     fclose(m_tracefp); m_tracefp=0;
 
@@ -1201,6 +1210,8 @@ bool CLogFile::BackupLogFile()
     rename(m_filename,bak_filename);
 
     if ((m_tracefp=FOPEN(m_filename,m_openmode)) == 0) return false;
+
+    m_nLogSize=0;
   }
 
   return true;
@@ -1210,20 +1221,35 @@ bool CLogFile::BackupLogFile()
 // Write方法会写入当前的时间，WriteEx方法不写时间。
 bool CLogFile::Write(const char *fmt,...)
 {
-  if (m_tracefp == 0) return false;
-
-  if (BackupLogFile() == false) return false;
+  if (m_sink != 0)
+  {
+    va_list ap;
+    va_start(ap,fmt);
+    bool bRet=m_sink->Append(true,fmt,ap);
+    va_end(ap);
+    return bRet;
+  }
 
   char strtime[20]; LocalTime(strtime);
 
+  // 多个线程同时写日志时，切换日志文件、写入和累计大小必须一起完成，
+  // 否则两个线程可能同时切换，一个线程关闭了另一个线程正在写入的文件。
+  pthread_mutex_lock(&m_mutex);
+
+  if ( (m_tracefp == 0) || (BackupLogFile() == false) ) { pthread_mutex_unlock(&m_mutex); return false; }
+
   va_list ap;
   va_start(ap,fmt);
-  fprintf(m_tracefp,"%s ",strtime);
-  vfprintf(m_tracefp,fmt,ap);
+  int iLen=fprintf(m_tracefp,"%s ",strtime);
+  if (iLen > 0) m_nLogSize=m_nLogSize+iLen;
+  iLen=vfprintf(m_tracefp,fmt,ap);
+  if (iLen > 0) m_nLogSize=m_nLogSize+iLen;
   va_end(ap);
 
   if (m_bEnBuffer==false) fflush(m_tracefp);
 
+  pthread_mutex_unlock(&m_mutex);
+
   return true;
 }
 
@@ -1231,18 +1257,46 @@ bool CLogFile::Write(const char *fmt,...)
 // Write方法会写入当前的时间，WriteEx方法不写时间。
 bool CLogFile::WriteEx(const char *fmt,...)
 {
-  if (m_tracefp == 0) return false;
+  if (m_sink != 0)
+  {
+    va_list ap;
+    va_start(ap,fmt);
+    bool bRet=m_sink->Append(false,fmt,ap);
+    va_end(ap);
+    return bRet;
+  }
+
+  pthread_mutex_lock(&m_mutex);
+
+  if (m_tracefp == 0) { pthread_mutex_unlock(&m_mutex); return false; }
 
   va_list ap;
   va_start(ap,fmt);
-  vfprintf(m_tracefp,fmt,ap);
+  int iLen=vfprintf(m_tracefp,fmt,ap);
+  if (iLen > 0) m_nLogSize=m_nLogSize+iLen;
   va_end(ap);
 
   if (m_bEnBuffer==false) fflush(m_tracefp);
 
+  pthread_mutex_unlock(&m_mutex);
+
   return true;
 }
 
+// 设置日志的写入后端，sink为0时恢复直接写文件。
+// 后端可能已经切换了日志文件，恢复直接写文件时重新打开日志文件。
+void CLogFile::SetSink(CLogSink *sink)
+{
+  if ( (sink == 0) && (m_sink != 0) && (m_tracefp != 0) )
+  {
+    fclose(m_tracefp);
+    m_tracefp=FOPEN(m_filename,m_openmode);
+    if (m_tracefp != 0) { fseek(m_tracefp,0L,2); m_nLogSize=ftell(m_tracefp); }
+  }
+
+  m_sink=sink;
+}
+
 CIniFile::CIniFile()
 {
   
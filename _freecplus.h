@@ -440,15 +440,30 @@ public:
 // 以下是日志文件操作类
 
 // 日志文件操作类
+// 日志的写入后端，设置后端以后，CLogFile的Write和WriteEx方法不再直接写文件，而是交给后端处理。
+class CLogSink
+{
+public:
+  // 写入一行日志。
+  // bTime：是否在内容前面写入当前的时间。
+  // fmt、ap：日志内容，使用方法与vprintf库函数相同。
+  virtual bool Append(bool bTime,const char *fmt,va_list ap)=0;
+
+  virtual ~CLogSink() {}
+};
+
 class CLogFile
 {
 public:
   FILE   *m_tracefp;           // 日志文件指针。
+  CLogSink *m_sink;            // 日志的写入后端，为0时直接写文件，缺省为0。
   char    m_filename[301];     // 日志文件名，建议采用绝对路径。
   char    m_openmode[11];      // 日志文件的打开方式，一般采用"a+"。
   bool    m_bEnBuffer;         // 写入日志时，是否启用操作系统的缓冲机制，缺省不启用。
   long    m_MaxLogSize;        // 最大日志文件的大小，单位M，缺省100M。
   bool    m_bBackup;           // 是否自动切换，日志文件大小超过m_MaxLogSize将自动切换，缺省启用。
+  long    m_nLogSize;          // 当前日志文件的大小，在内存中累计，不需要每次写入都调用fseek和ftell。
+  pthread_mutex_t m_mutex;     // 直接写文件时的互斥锁，多个线程同时写日志时保护m_tracefp和m_nLogSize。
 
   // 构造函数。
   // MaxLogSize：最大日志文件的大小，单位M，缺省100M，最小为10M。
@@ -462,6 +477,8 @@ public:
   bool Open(const char *filename,const char *openmode=0,bool bBackup=true,bool bEnBuffer=false);
 
   // 如果日志文件大于m_MaxLogSize的值，就把当前的日志文件名改为历史日志文件名，再创建新的当前日志文件。
+  // 日志文件的大小取自m_nLogSize，打开文件时读取一次，之后由Write和WriteEx累计。
+  // 由Write在持有m_mutex时调用，不能在其他线程写日志的同时直接调用。
   // 备份后的文件会在日志文件名后加上日期时间，如/tmp/log/filetodb.log.20200101123025。
   // 注意，在多进程的程序中，日志文件不可切换，多线的程序中，日志文件可以切换。
   bool BackupLogFile();
@@ -471,6 +488,10 @@ public:
   bool Write(const char *fmt,...);
   bool WriteEx(const char *fmt,...);
 
+  // 设置日志的写入后端，例如异步写入，sink为0时恢复直接写文件。
+  // 后端可能已经切换了日志文件，恢复直接写文件时会重新打开日志文件。
+  void SetSink(CLogSink *sink);
+
   // 关闭日志文件
   void Close();
 
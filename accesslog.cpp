@@ -0,0 +1,76 @@
+#include <string.h>
+#include <time.h>
+#include "accesslog.h"
+
+//当前线程已经写过路径记录的路径哈希值，按哈希值的低位直接映射
+static thread_local uint64_t t_paths[ACCESS_PATH_CACHE];
+static thread_local uint32_t t_epoch = 0;//t_paths对应的日志文件序号
+
+AccessLog::AccessLog() : m_open(false) {}
+
+bool AccessLog::open(const char* filename, long max_bytes, int period, int keep) {
+    access_file_record header;
+    memset(&header, 0, sizeof(header));
+    header.type = ACCESS_RECORD_FILE;
+    header.size = sizeof(header);
+    header.magic = ACCESS_LOG_MAGIC;
+    header.version = ACCESS_LOG_VERSION;
+    m_log.setRotation(period, keep);
+    m_open = m_log.start(filename, max_bytes, true, &header, sizeof(header));
+    return m_open;
+}
+
+void AccessLog::close() {
+    m_open = false;
+    m_log.stop();
+}
+
+void AccessLog::write(const sockaddr_in& addr, int method, std::string_view path, int status, uint64_t bytes, uint32_t latency_us) {
+    //路径记录和请求记录放在一起，一次写入
+    alignas(8) char buf[sizeof(access_path_record) + ACCESS_PATH_MAX + 8 + sizeof(access_request_record)];
+    int len = 0;
+
+    uint64_t path_id = path.empty() ? 0 : access_path_id(path.data(), path.size());
+    uint32_t epoch = m_log.epoch();
+    if (epoch != t_epoch) {//日志文件切换了，新文件中还没有任何路径记录
+        memset(t_paths, 0, sizeof(t_paths));
+        t_epoch = epoch;
+    }
+    uint64_t* slot = &t_paths[path_id & (ACCESS_PATH_CACHE - 1)];
+    bool new_path = path_id != 0 && *slot != path_id;
+    if (new_path) {
+        int n = (path.size() > ACCESS_PATH_MAX) ? ACCESS_PATH_MAX : path.size();
+        access_path_record* rec = (access_path_record*)buf;
+        rec->type = ACCESS_RECORD_PATH;
+        rec->size = (sizeof(access_path_record) + n + 7) & ~7;
+        rec->len = n;
+        rec->reserved = 0;
+        rec->path_id = path_id;
+        memcpy(buf + sizeof(access_path_record), path.data(), n);
+        memset(buf + sizeof(access_path_record) + n, 0, rec->size - sizeof(access_path_record) - n);
+        len = rec->size;
+    }
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    access_request_record* req = (access_request_record*)(buf + len);
+    req->type = ACCESS_RECORD_REQUEST;
+    req->size = sizeof(access_request_record);
+    req->status = status;
+    req->method = method;
+    req->reserved = 0;
+    req->time_us = (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+    req->addr = addr.sin_addr.s_addr;
+    req->port = ntohs(addr.sin_port);
+    req->reserved2 = 0;
+    req->path_id = path_id;
+    req->bytes = bytes;
+    req->latency_us = latency_us;
+    req->reserved3 = 0;
+    len += sizeof(access_request_record);
+
+    //写入失败时路径记录也丢了，下次还要再写
+    if (m_log.AppendRaw(buf, len) && new_path) {
+        *slot = path_id;
+    }
+}
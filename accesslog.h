@@ -0,0 +1,37 @@
+/*
+    本程序实现二进制访问日志的写入
+    每个响应结束时写一条固定长度的请求记录，不做任何文本格式化，由AsyncLog的后台线程批量写入文件；
+    每个写线程用一个直接映射表记住已经写过路径记录的路径，被挤出表的路径再遇到时重新写一次，日志文件切换后全部重新写；
+    路径记录和引用它的请求记录一起写入，不会被拆到两个文件中，但之前已经写过的路径仍然可能只出现在上一个文件里，
+    所以解码时最好把切换出的多个文件按时间顺序一起交给解码工具
+*/
+#ifndef ACCESSLOG_H
+#define ACCESSLOG_H
+
+#include <netinet/in.h>
+#include <string_view>
+#include "asynclog.h"
+#include "accessrecord.h"
+
+#define ACCESS_PATH_CACHE 256 // 每个线程记住的路径个数，必须是2的幂
+
+class AccessLog {
+public:
+    AccessLog();//构造函数
+
+    //打开访问日志并启动后台线程，日志文件超过max_bytes或者到了period的整点时切换，保留keep个历史文件
+    bool open(const char* filename, long max_bytes, int period, int keep);
+    //写完缓冲的记录后关闭
+    void close();
+    bool isOpen() { return m_open; }
+    //写一条请求记录，method为http_conn::METHOD或者ACCESS_METHOD_UNKNOWN，path为空表示没有解析出路径
+    void write(const sockaddr_in& addr, int method, std::string_view path, int status, uint64_t bytes, uint32_t latency_us);
+    //缓冲区满时丢弃的记录数
+    long dropped() { return m_log.dropped(); }
+
+private:
+    AsyncLog m_log;
+    bool m_open;
+};
+
+#endif
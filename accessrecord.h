@@ -0,0 +1,69 @@
+/*
+    本程序定义二进制访问日志的记录格式，服务器和离线解码工具tools/accesslog_decode共用
+    日志文件以文件头记录开始，之后是路径记录和请求记录；所有记录都以type和size开始，size为整个记录的字节数，
+    是8的倍数，解码时不认识的记录类型按size跳过；字段按主机字节序写入，在同一种机器上解码；
+    请求记录长度固定，路径用64位哈希值表示，路径本身由路径记录给出，一个写线程第一次遇到某个路径时写一次
+*/
+#ifndef ACCESSRECORD_H
+#define ACCESSRECORD_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#define ACCESS_LOG_MAGIC 0x474f4c41u // 文件头中的魔数，小端机器上是"ALOG"
+#define ACCESS_LOG_VERSION 1
+#define ACCESS_PATH_MAX 1024 // 路径记录中路径的最大长度，超过的部分截断
+#define ACCESS_METHOD_UNKNOWN 255 // 请求行没有解析成功，如400和503
+
+enum ACCESS_RECORD_TYPE {ACCESS_RECORD_FILE = 1, ACCESS_RECORD_PATH, ACCESS_RECORD_REQUEST};
+
+//文件头，每个日志文件开头一个
+struct access_file_record {
+    uint16_t type;//ACCESS_RECORD_FILE
+    uint16_t size;
+    uint32_t magic;//ACCESS_LOG_MAGIC
+    uint32_t version;//ACCESS_LOG_VERSION
+    uint32_t reserved;
+};
+
+//路径记录，后面紧跟len个字节的路径，再补0到8字节对齐
+struct access_path_record {
+    uint16_t type;//ACCESS_RECORD_PATH
+    uint16_t size;
+    uint16_t len;
+    uint16_t reserved;
+    uint64_t path_id;
+};
+
+//请求记录，每个响应结束时一条
+struct access_request_record {
+    uint16_t type;//ACCESS_RECORD_REQUEST
+    uint16_t size;
+    uint16_t status;//响应状态码
+    uint8_t method;//http_conn::METHOD，ACCESS_METHOD_UNKNOWN表示不知道
+    uint8_t reserved;
+    uint64_t time_us;//响应结束的时间，1970年以来的微秒数
+    uint32_t addr;//客户端IPv4地址，网络字节序
+    uint16_t port;//客户端端口，主机字节序
+    uint16_t reserved2;
+    uint64_t path_id;//路径的哈希值，0表示没有解析出路径
+    uint64_t bytes;//发送的字节数，包括响应头
+    uint32_t latency_us;//从收到请求的第一个字节到响应结束的微秒数
+    uint32_t reserved3;
+};
+
+static_assert(sizeof(access_file_record) == 16, "access log record layout changed");
+static_assert(sizeof(access_path_record) == 16, "access log record layout changed");
+static_assert(sizeof(access_request_record) == 48, "access log record layout changed");
+
+//路径的哈希值，FNV-1a，0留给没有路径的请求
+inline uint64_t access_path_id(const char* path, size_t len) {
+    uint64_t h = 14695981039346656037ull;
+    for (size_t i = 0; i < len; ++i) {
+        h ^= (unsigned char)path[i];
+        h *= 1099511628211ull;
+    }
+    return (h == 0) ? 1 : h;
+}
+
+#endif
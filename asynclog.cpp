@@ -0,0 +1,301 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include "asynclog.h"
+
+//写线程的环形缓冲区，每个AsyncLog一个，线程同时写文本日志和访问日志时各有一个
+struct RingSlot {
+    const AsyncLog* owner;
+    void* ring;
+};
+static thread_local RingSlot t_rings[LOG_OWNER_SLOTS];
+
+//写线程缓存的时间前缀，如"2020-01-01 12:30:25 "，秒数变化时才重新生成
+struct LogTime {
+    time_t sec;
+    char text[64];//只用前20个字节，留出snprintf认为可能需要的长度
+};
+static thread_local LogTime t_time = {-1, ""};
+
+static int log_time(char* buf) {
+    time_t now = time(nullptr);
+    if (now != t_time.sec) {
+        struct tm tm;
+        localtime_r(&now, &tm);
+        snprintf(t_time.text, sizeof(t_time.text), "%04d-%02d-%02d %02d:%02d:%02d ", tm.tm_year + 1900,
+                 tm.tm_mon + 1, tm.tm_mday, tm.tm_hour, tm.tm_min, tm.tm_sec);
+        t_time.sec = now;
+    }
+    memcpy(buf, t_time.text, 20);
+    return 20;
+}
+
+AsyncLog::AsyncLog() : m_fd(-1), m_period(LOG_PERIOD_NONE), m_keep(0), m_bytes(0), m_running(false),
+    m_rings(nullptr), m_stop(false), m_sleeping(false), m_dropped(0), m_reported(0), m_epoch(0) {}
+
+AsyncLog::~AsyncLog() {
+    stop();
+    Ring* ring = m_rings.load();
+    while (ring != nullptr) {
+        Ring* next = ring->next;
+        delete ring;
+        ring = next;
+    }
+}
+
+bool AsyncLog::start(const char* filename, long max_bytes, bool backup, const void* header, int header_len) {
+    m_filename = filename;
+    m_header.assign((const char*)header, (header == nullptr) ? 0 : header_len);
+    if (!open_file()) {
+        return false;
+    }
+    if (!m_rotator.init(filename, backup ? max_bytes : 0, backup ? m_period : LOG_PERIOD_NONE, m_keep)) {
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    m_stop = false;
+    if (pthread_create(&m_thread, nullptr, worker, this) != 0) {
+        close(m_fd);
+        m_fd = -1;
+        return false;
+    }
+    m_running = true;
+    return true;
+}
+
+void AsyncLog::stop() {
+    if (!m_running) {
+        return;
+    }
+    m_stop = true;
+    m_futex.wake(1);
+    pthread_join(m_thread, nullptr);//后台线程写完所有数据后退出
+    m_running = false;
+    close(m_fd);
+    m_fd = -1;
+    m_rotator.stop();//等待最后切换出的文件压缩完
+}
+
+bool AsyncLog::open_file() {
+    m_fd = open(m_filename.c_str(), O_WRONLY | O_CREAT | O_APPEND | O_CLOEXEC, 0644);
+    if (m_fd == -1) {
+        return false;
+    }
+    struct stat st;
+    m_bytes = (fstat(m_fd, &st) == 0) ? st.st_size : 0;//追加写入，从已有的大小开始累计
+    if (m_bytes == 0 && !m_header.empty() && write(m_fd, m_header.data(), m_header.size()) > 0) {
+        m_bytes = m_header.size();
+    }
+    m_epoch.fetch_add(1, std::memory_order_release);
+    return true;
+}
+
+AsyncLog::Ring* AsyncLog::local_ring() {
+    int free_slot = -1;
+    for (int i = 0; i < LOG_OWNER_SLOTS; ++i) {
+        if (t_rings[i].owner == this) {
+            return (Ring*)t_rings[i].ring;
+        }
+        if (t_rings[i].owner == nullptr && free_slot == -1) {
+            free_slot = i;
+        }
+    }
+    if (free_slot == -1) {//一个线程写的AsyncLog超过了LOG_OWNER_SLOTS个
+        return nullptr;
+    }
+    //线程第一次写这个日志，创建缓冲区并加入链表
+    Ring* ring = new Ring;
+    ring->head.store(0, std::memory_order_relaxed);
+    ring->tail.store(0, std::memory_order_relaxed);
+    ring->next = m_rings.load(std::memory_order_relaxed);
+    while (!m_rings.compare_exchange_weak(ring->next, ring, std::memory_order_release, std::memory_order_relaxed)) {
+    }
+    t_rings[free_slot].owner = this;
+    t_rings[free_slot].ring = ring;
+    return ring;
+}
+
+bool AsyncLog::Append(bool bTime, const char* fmt, va_list ap) {
+    char line[LOG_LINE_MAX];
+    int len = bTime ? log_time(line) : 0;
+    int n = vsnprintf(line + len, sizeof(line) - len, fmt, ap);
+    if (n < 0) {
+        return false;
+    }
+    len += n;
+    if (len > LOG_LINE_MAX - 1) {//被截断，保留行结束符
+        len = LOG_LINE_MAX - 1;
+        line[len - 1] = '\n';
+    }
+    return push(line, len);
+}
+
+bool AsyncLog::AppendRaw(const void* data, int len) {
+    return push((const char*)data, len);
+}
+
+bool AsyncLog::push(const char* data, int len) {
+    Ring* ring = local_ring();
+    if (ring == nullptr) {
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    uint64_t head = ring->head.load(std::memory_order_relaxed);
+    uint64_t tail = ring->tail.load(std::memory_order_acquire);
+    if (LOG_RING_SIZE - (head - tail) < (uint64_t)len) {//后台线程跟不上，丢弃这一行，不等待
+        m_dropped.fetch_add(1, std::memory_order_relaxed);
+        return false;
+    }
+    int pos = head & (LOG_RING_SIZE - 1);
+    int first = (len < LOG_RING_SIZE - pos) ? len : LOG_RING_SIZE - pos;
+    memcpy(ring->buf + pos, data, first);
+    memcpy(ring->buf, data + first, len - first);//回绕到缓冲区开头
+    //发布数据和检查休眠标志之间需要全序，与run中先设置休眠标志再检查缓冲区配对，避免丢失唤醒
+    ring->head.store(head + len, std::memory_order_seq_cst);
+    if (m_sleeping.load(std::memory_order_seq_cst)) {
+        m_futex.wake(1);
+    }
+    return true;
+}
+
+void* AsyncLog::worker(void* arg) {
+    ((AsyncLog*)arg)->run();
+    return nullptr;
+}
+
+void AsyncLog::run() {
+    while (true) {
+        int seq = m_futex.prepare();
+        bool stopping = m_stop.load();//先读停止标志再写数据，停止之前写入的日志都会被写完
+        if (flush()) {
+            continue;
+        }
+        if (stopping) {
+            break;
+        }
+        m_sleeping.store(true, std::memory_order_seq_cst);
+        if (empty()) {
+            m_futex.wait(seq);
+        }
+        m_sleeping.store(false, std::memory_order_relaxed);
+    }
+    report_dropped();
+}
+
+bool AsyncLog::empty() {
+    for (Ring* ring = m_rings.load(std::memory_order_acquire); ring != nullptr; ring = ring->next) {
+        if (ring->head.load(std::memory_order_seq_cst) != ring->tail.load(std::memory_order_relaxed)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+bool AsyncLog::flush() {
+    struct iovec iov[LOG_IOV_MAX];
+    Ring* rings[LOG_IOV_MAX / 2];
+    uint64_t heads[LOG_IOV_MAX / 2];
+    int iovcnt = 0;
+    int count = 0;
+    long total = 0;
+    for (Ring* ring = m_rings.load(std::memory_order_acquire); ring != nullptr && count < LOG_IOV_MAX / 2; ring = ring->next) {
+        uint64_t tail = ring->tail.load(std::memory_order_relaxed);
+        uint64_t head = ring->head.load(std::memory_order_acquire);
+        if (head == tail) {
+            continue;
+        }
+        int pos = tail & (LOG_RING_SIZE - 1);
+        int len = head - tail;
+        int first = (len < LOG_RING_SIZE - pos) ? len : LOG_RING_SIZE - pos;
+        iov[iovcnt].iov_base = ring->buf + pos;
+        iov[iovcnt].iov_len = first;
+        ++iovcnt;
+        if (len > first) {
+            iov[iovcnt].iov_base = ring->buf;
+            iov[iovcnt].iov_len = len - first;
+            ++iovcnt;
+        }
+        rings[count] = ring;
+        heads[count] = head;
+        ++count;
+        total += len;
+    }
+    if (count == 0) {
+        return false;
+    }
+
+    if (m_fd == -1) {//上次切换时没能创建新文件，再试一次
+        open_file();
+    }
+    //写入之前判断，过了整点以后的第一批日志写入新文件；文件头不算内容，只有文件头的文件不切换
+    time_t now = time(nullptr);
+    if (m_fd != -1 && m_rotator.due(m_bytes - (long)m_header.size(), now)) {
+        rotate(now);
+    }
+    write_all(iov, iovcnt);//写失败时丢弃这一批，不能让写线程的缓冲区一直满着
+    for (int i = 0; i < count; ++i) {
+        rings[i]->tail.store(heads[i], std::memory_order_release);
+    }
+    m_bytes += total;
+    report_dropped();
+    return true;
+}
+
+bool AsyncLog::write_all(struct iovec* iov, int iovcnt) {
+    if (m_fd == -1) {
+        return false;
+    }
+    while (iovcnt > 0) {
+        ssize_t n = writev(m_fd, iov, iovcnt);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            return false;
+        }
+        while (iovcnt > 0 && (size_t)n >= iov->iov_len) {//跳过已经写完的段
+            n -= iov->iov_len;
+            ++iov;
+            --iovcnt;
+        }
+        if (iovcnt > 0) {//部分写入，从段中间继续
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= n;
+        }
+    }
+    return true;
+}
+
+void AsyncLog::report_dropped() {
+    if (!m_header.empty()) {//二进制日志不能混入文本，丢弃的记录数只能由写入者自己统计
+        return;
+    }
+    //m_dropped同时作为统计导出，不能清零，只记录上次写到了哪里
+    long total = m_dropped.load(std::memory_order_relaxed);
+    long dropped = total - m_reported;
+    m_reported = total;
+    if (dropped == 0 || m_fd == -1) {
+        return;
+    }
+    char line[64];
+    int len = log_time(line);
+    len += snprintf(line + len, sizeof(line) - len, "\t%ld log lines dropped\n", dropped);
+    if (write(m_fd, line, len) > 0) {
+        m_bytes += len;
+    }
+}
+
+void AsyncLog::rotate(time_t now) {
+    close(m_fd);
+    m_fd = -1;
+    m_rotator.rotate(now);//改名以后由压缩线程压缩，这里不等待
+    if (!open_file()) {
+        m_bytes = 0;
+    }
+}
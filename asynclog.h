@@ -0,0 +1,83 @@
+/*
+    本程序实现CLogFile的异步写入后端
+    每个写日志的线程第一次写入时得到自己的环形缓冲区，只有这个线程写、后台线程读，不需要加锁；
+    调用者只在自己的线程中格式化并复制到环形缓冲区，不进行任何磁盘操作，缓冲区满时丢弃这一行并计数；
+    后台线程把所有缓冲区中的数据用一次writev写入文件，文件大小在内存中累计，按大小或者时间切换日志文件，见logrotate.h；
+    不同线程的日志按批次写入，同一个线程的日志保持先后顺序；
+    除了文本日志，也可以写入不需要格式化的二进制记录，见accesslog.h
+*/
+#ifndef ASYNCLOG_H
+#define ASYNCLOG_H
+
+#include <atomic>
+#include <string>
+#include <pthread.h>
+#include "futex.h"
+#include "logrotate.h"
+#include "_freecplus.h"
+
+#define LOG_RING_SIZE (64 * 1024) // 每个线程的环形缓冲区大小，必须是2的幂
+#define LOG_LINE_MAX 1024 // 一行日志的最大长度，超过的部分截断
+#define LOG_IOV_MAX 1024 // 一次writev的最多段数，每个环形缓冲区最多占两段
+#define LOG_OWNER_SLOTS 4 // 一个线程最多同时向几个AsyncLog写入
+
+class AsyncLog : public CLogSink {
+public:
+    AsyncLog();//构造函数
+    ~AsyncLog();//析构函数，会调用stop
+
+    //按时间切换的周期和保留的历史文件个数，在start之前调用，缺省只按大小切换、不限个数
+    void setRotation(int period, int keep) { m_period = period; m_keep = keep; }
+    //打开日志文件并启动后台线程，max_bytes为日志文件的最大字节数，backup为false时不切换
+    //header不为空时，每个新的日志文件都先写入这header_len个字节，用于二进制日志的文件头
+    bool start(const char* filename, long max_bytes, bool backup, const void* header = nullptr, int header_len = 0);
+    //写完所有已经缓冲的日志后停止后台线程并关闭文件，调用前其他线程要停止写日志
+    void stop();
+    //由CLogFile的Write和WriteEx调用，可以在任意线程中调用
+    bool Append(bool bTime, const char* fmt, va_list ap) override;
+    //写入len个字节的二进制数据，不经过格式化，同一次写入的数据不会被拆到两个日志文件中
+    bool AppendRaw(const void* data, int len);
+    //当前日志文件的序号，每次切换加1，写线程据此判断文件头之后的定义记录是否需要重新写入
+    uint32_t epoch() { return m_epoch.load(std::memory_order_acquire); }
+    //缓冲区满时丢弃的记录总数，只增不减，可以直接作为计数器导出
+    long dropped() { return m_dropped.load(std::memory_order_relaxed); }
+
+private:
+    struct Ring {
+        char buf[LOG_RING_SIZE];
+        alignas(64) std::atomic<uint64_t> head;//写线程写入的总字节数
+        alignas(64) std::atomic<uint64_t> tail;//后台线程写完的总字节数
+        Ring* next;
+    };
+
+    Ring* local_ring();//当前线程的环形缓冲区，第一次调用时创建
+    bool push(const char* data, int len);//复制到当前线程的环形缓冲区
+    bool open_file();//打开日志文件，空文件先写入文件头
+    static void* worker(void* arg);
+    void run();//后台线程的主循环
+    bool flush();//把所有缓冲区中的数据写入文件，没有数据时返回false
+    bool empty();//所有缓冲区是否都没有数据
+    bool write_all(struct iovec* iov, int iovcnt);
+    void report_dropped();//把丢弃的行数写入日志
+    void rotate(time_t now);//把日志文件交给m_rotator改名为历史文件，再创建新的日志文件
+
+private:
+    std::string m_filename;
+    std::string m_header;
+    int m_fd;
+    int m_period;//LOG_PERIOD
+    int m_keep;
+    LogRotator m_rotator;
+    long m_bytes;//当前日志文件的字节数，由后台线程累计，不需要fseek和ftell
+    pthread_t m_thread;
+    bool m_running;
+    std::atomic<Ring*> m_rings;//所有线程的环形缓冲区，只增加，stop之后释放
+    std::atomic<bool> m_stop;
+    std::atomic<bool> m_sleeping;//后台线程是否准备休眠，写线程只在这时唤醒它
+    std::atomic<long> m_dropped;//缓冲区满时丢弃的行数，不清零
+    long m_reported;//已经写入文本日志的丢弃行数，只在后台线程中使用
+    std::atomic<uint32_t> m_epoch;
+    Futex m_futex;
+};
+
+#endif
@@ -0,0 +1,72 @@
+#include "bufpool.h"
+
+BufPool::BufPool() {
+    for (int i = 0; i < BUF_CLASSES; ++i) {
+        m_classes[i].head = nullptr;
+    }
+}
+
+BufPool::~BufPool() {
+    for (size_t i = 0; i < m_slabs.size(); ++i) {
+        delete[] m_slabs[i];
+    }
+}
+
+int BufPool::classOf(int size) {
+    int cls = 0;
+    while (cls < BUF_CLASSES && (1 << (BUF_MIN_SHIFT + cls)) < size) {
+        ++cls;
+    }
+    return (cls == BUF_CLASSES) ? -1 : cls;
+}
+
+void BufPool::refill(int cls) {
+    int block = 1 << (BUF_MIN_SHIFT + cls);
+    int count = (block >= BUF_SLAB_SIZE) ? 1 : BUF_SLAB_SIZE / block;
+    char* slab = new char[(size_t)block * count];
+    m_slab_locker.lock();
+    m_slabs.push_back(slab);
+    m_slab_locker.unlock();
+
+    //从后往前串起来，申请时按地址顺序取出
+    for (int i = count - 1; i >= 0; --i) {
+        FreeNode* node = (FreeNode*)(slab + (size_t)block * i);
+        node->next = m_classes[cls].head;
+        m_classes[cls].head = node;
+    }
+}
+
+char* BufPool::alloc(int size, int* cap) {
+    int cls = classOf(size);
+    if (cls == -1) {//太大，不放进池中
+        *cap = size;
+        return new char[size];
+    }
+    SizeClass& sc = m_classes[cls];
+    sc.locker.lock();
+    if (sc.head == nullptr) {
+        refill(cls);
+    }
+    FreeNode* node = sc.head;
+    sc.head = node->next;
+    sc.locker.unlock();
+    *cap = 1 << (BUF_MIN_SHIFT + cls);
+    return (char*)node;
+}
+
+void BufPool::free(char* buf, int cap) {
+    if (buf == nullptr) {
+        return;
+    }
+    int cls = classOf(cap);
+    if (cls == -1) {
+        delete[] buf;
+        return;
+    }
+    SizeClass& sc = m_classes[cls];
+    FreeNode* node = (FreeNode*)buf;
+    sc.locker.lock();
+    node->next = sc.head;
+    sc.head = node;
+    sc.locker.unlock();
+}
@@ -0,0 +1,49 @@
+/*
+    本程序实现连接缓冲区的内存池
+    缓冲区按大小分级，从BUF_MIN_SIZE开始每级翻倍，同一级的空闲缓冲区用单链表串起来；
+    某一级没有空闲缓冲区时一次向系统申请一整块slab，切成多个缓冲区放入空闲链表，
+    释放的缓冲区回到所属级别的空闲链表，不还给系统，下次申请不需要调用malloc；
+    超过最大级别的申请直接用new分配，释放时delete
+*/
+#ifndef BUFPOOL_H
+#define BUFPOOL_H
+
+#include <stddef.h>
+#include <vector>
+#include "locker.h"
+
+#define BUF_MIN_SHIFT 8 // 最小一级缓冲区为256字节
+#define BUF_CLASSES 9 // 级别数量，最大一级为64K
+#define BUF_SLAB_SIZE (64 * 1024) // 每次向系统申请的slab大小，大于它的级别每个slab只切一个缓冲区
+
+class BufPool {
+public:
+    BufPool();//构造函数
+    ~BufPool();//析构函数
+
+    //申请至少size字节的缓冲区，实际容量保存在cap中，释放时要原样传回
+    char* alloc(int size, int* cap);
+    //释放alloc得到的缓冲区
+    void free(char* buf, int cap);
+
+private:
+    //空闲缓冲区的头部用来保存链表指针
+    struct FreeNode {
+        FreeNode* next;
+    };
+    //一个级别的空闲链表，多个事件循环和工作线程同时申请释放，每一级一把锁，减少争用
+    struct SizeClass {
+        Locker locker;
+        FreeNode* head;
+    };
+
+    static int classOf(int size);//size所属的级别，超过最大级别返回-1
+    void refill(int cls);//向系统申请一个slab切开放入第cls级的空闲链表，加锁后调用
+
+private:
+    SizeClass m_classes[BUF_CLASSES];
+    std::vector<char*> m_slabs;//所有slab，析构时释放
+    Locker m_slab_locker;//保护m_slabs
+};
+
+#endif
@@ -0,0 +1,47 @@
+#include "conntable.h"
+#include "http_conn.h"
+
+ConnTable::ConnTable(int capacity) {
+    if (capacity <= 0 || capacity > MAX_CONN_TABLE_SIZE) {
+        capacity = MAX_CONN_TABLE_SIZE;
+    }
+    m_capacity = capacity;
+    m_chunk_count = (capacity + CONN_CHUNK_SIZE - 1) / CONN_CHUNK_SIZE;
+    m_chunks = new std::atomic<http_conn*>[m_chunk_count];
+    for (int i = 0; i < m_chunk_count; ++i) {
+        m_chunks[i].store(nullptr, std::memory_order_relaxed);
+    }
+}
+
+ConnTable::~ConnTable() {
+    for (int i = 0; i < m_chunk_count; ++i) {
+        delete[] m_chunks[i].load(std::memory_order_relaxed);
+    }
+    delete[] m_chunks;
+}
+
+http_conn* ConnTable::get(int fd) {
+    if (fd < 0 || fd >= m_capacity) {
+        return nullptr;
+    }
+    int idx = fd / CONN_CHUNK_SIZE;
+    http_conn* chunk = m_chunks[idx].load(std::memory_order_acquire);
+    if (chunk == nullptr) {//双重检查，块只在第一次使用时加锁分配
+        m_locker.lock();
+        chunk = m_chunks[idx].load(std::memory_order_relaxed);
+        if (chunk == nullptr) {
+            chunk = new http_conn[CONN_CHUNK_SIZE];
+            m_chunks[idx].store(chunk, std::memory_order_release);
+        }
+        m_locker.unlock();
+    }
+    return chunk + fd % CONN_CHUNK_SIZE;
+}
+
+http_conn* ConnTable::find(int fd) {
+    if (fd < 0 || fd >= m_capacity) {
+        return nullptr;
+    }
+    http_conn* chunk = m_chunks[fd / CONN_CHUNK_SIZE].load(std::memory_order_acquire);
+    return (chunk == nullptr) ? nullptr : chunk + fd % CONN_CHUNK_SIZE;
+}
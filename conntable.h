@@ -0,0 +1,34 @@
+/*
+    本程序实现按文件描述符索引的连接表
+    容量由启动时的RLIMIT_NOFILE决定，文件描述符不会超过这个值；
+    连接按块分配，某个文件描述符第一次被使用时才分配它所在的块，已经分配的块在进程退出前不会释放，
+    所以http_conn的地址一直有效，可以交给工作线程
+*/
+#ifndef CONNTABLE_H
+#define CONNTABLE_H
+
+#include <atomic>
+#include "locker.h"
+
+#define CONN_CHUNK_SIZE 1024 // 每块的连接数量
+#define MAX_CONN_TABLE_SIZE (1 << 20) // 连接表的最大容量，RLIMIT_NOFILE没有上限时使用
+
+class http_conn;
+
+class ConnTable {
+public:
+    ConnTable(int capacity);//构造函数，capacity为最多能容纳的文件描述符数量
+    ~ConnTable();//析构函数
+
+    int capacity() { return m_capacity; }
+    http_conn* get(int fd);//fd对应的连接，所在的块没有分配时先分配，fd超出容量时返回nullptr
+    http_conn* find(int fd);//fd对应的连接，所在的块没有分配时返回nullptr，不分配
+
+private:
+    int m_capacity;
+    int m_chunk_count;
+    std::atomic<http_conn*>* m_chunks;//多个事件循环同时接收连接，块指针用原子变量发布
+    Locker m_locker;//分配块时加锁，防止两个线程同时分配同一块
+};
+
+#endif
@@ -0,0 +1,440 @@
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include <sys/signalfd.h>
+#include <signal.h>
+#include <sched.h>
+#include "eventloop.h"
+#include "http_conn.h"
+#include "conntable.h"
+#include "handoff.h"
+#include "metrics.h"
+#include "logging.h"
+
+extern FileCache filecache;
+extern Metrics metrics;
+extern void adfd (int epollfd, int fd, bool oneshoot, bool et, uint32_t gen = 0);
+
+EventLoop::EventLoop() : m_index(0), m_epollfd(-1), m_wakeupfd(-1), m_listenfd(-1), m_idlefd(-1), m_throttled(false), m_timerfd(-1), m_armed(-1),
+    m_notifyfd(-1), m_sigfd(-1), m_handofffd(-1), m_listenfds(nullptr), m_thread(0), m_users(nullptr), m_pool(nullptr),
+    m_subloops(nullptr), m_next(0), m_draining(false), m_drain_request(false), m_drain_deadline(0), m_handed_off(false) {}
+
+EventLoop::~EventLoop() {
+    if (m_idlefd != -1) {
+        close(m_idlefd);
+    }
+    if (m_wakeupfd != -1) {
+        close(m_wakeupfd);
+    }
+    if (m_timerfd != -1) {
+        close(m_timerfd);
+    }
+    if (m_epollfd != -1) {
+        close(m_epollfd);
+    }
+}
+
+bool EventLoop::init(int index, ConnTable* users, ThreadPool<http_conn>* pool) {
+    m_index = index;
+    m_users = users;
+    m_pool = pool;
+
+    m_epollfd = epoll_create(5);//每个循环独占一个epoll实例
+    if (m_epollfd == -1) {
+        return false;
+    }
+
+    //eventfd用于其他线程投递新连接或定时任务后唤醒本循环
+    m_wakeupfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (m_wakeupfd == -1) {
+        return false;
+    }
+    adfd(m_epollfd, m_wakeupfd, false, false);
+
+    //每个循环用自己的timerfd驱动时间轮，精度到毫秒，不再依赖alarm和SIGALRM
+    m_timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (m_timerfd == -1) {
+        return false;
+    }
+    adfd(m_epollfd, m_timerfd, false, false);
+    return true;
+}
+
+void EventLoop::setListenFd(int listenfd) {
+    m_listenfd = listenfd;
+    m_idlefd = open("/dev/null", O_RDONLY | O_CLOEXEC);//预留一个文件描述符，防止EMFILE时监听套接字一直可读
+    adfd(m_epollfd, listenfd, false, true);//将监听文件描述符以边沿触发方式添加到本循环的epoll中
+}
+
+void EventLoop::setNotifyFd(int notifyfd) {
+    m_notifyfd = notifyfd;
+    adfd(m_epollfd, notifyfd, false, false);//文件被修改或删除时使对应的缓存失效
+}
+
+void EventLoop::setSignalFd(int sigfd) {
+    m_sigfd = sigfd;
+    adfd(m_epollfd, sigfd, false, false);
+}
+
+void EventLoop::setHandoffFd(int handofffd, std::vector<int>* listenfds) {
+    m_handofffd = handofffd;
+    m_listenfds = listenfds;
+    adfd(m_epollfd, handofffd, false, false);
+}
+
+void EventLoop::setSubLoops(std::vector<EventLoop*>* loops) {
+    m_subloops = loops;
+}
+
+bool EventLoop::startThread() {
+    return pthread_create(&m_thread, nullptr, work, this) == 0;
+}
+
+void EventLoop::join() {
+    if (m_thread != 0) {
+        pthread_join(m_thread, nullptr);
+        m_thread = 0;
+    }
+}
+
+void* EventLoop::work(void* arg) {
+    EventLoop* loop = (EventLoop*)arg;
+
+    //把子循环绑定到固定的CPU核上，减少线程迁移带来的缓存失效
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    if (ncpu > 0) {
+        cpu_set_t cpuset;
+        CPU_ZERO(&cpuset);
+        CPU_SET(loop->m_index % ncpu, &cpuset);
+        pthread_setaffinity_np(pthread_self(), sizeof(cpuset), &cpuset);
+    }
+
+    loop->loop();
+    return loop;
+}
+
+void EventLoop::queueDrain() {
+    m_drain_request = true;
+    wakeup();
+}
+
+void EventLoop::wakeup() {
+    uint64_t one = 1;
+    write(m_wakeupfd, &one, sizeof(one));
+}
+
+void EventLoop::queueConn(int sockfd, const sockaddr_in& addr) {
+    PendingConn conn;
+    conn.sockfd = sockfd;
+    conn.addr = addr;
+    m_pendinglocker.lock();
+    m_pending.push_back(conn);
+    m_pendinglocker.unlock();
+    wakeup();
+}
+
+void EventLoop::returnConn(http_conn* conn, int action) {
+    ReturnedConn ret;
+    ret.conn = conn;
+    ret.gen = conn->getGeneration();
+    ret.action = action;
+    m_pendinglocker.lock();
+    m_returned.push_back(ret);
+    m_pendinglocker.unlock();
+    wakeup();
+}
+
+//监听套接字是边沿触发的，每次唤醒都要循环接收，直到把全连接队列中的连接全部取完
+//线程池过载时停止接收，剩下的连接留在全连接队列中，恢复后由loop主动调用本函数取出
+void EventLoop::handleAccept() {
+    while (true) {
+        if (overloaded()) {
+            if (!m_throttled) {
+                LOG_WARN("\tThread pool overloaded, stop accepting\n");
+            }
+            m_throttled = true;
+            break;
+        }
+        uint64_t start = metrics.clock();
+        sockaddr_in caddr;
+        socklen_t len  = sizeof(caddr);
+        //accept4直接把新套接字设置为非阻塞，省去每个连接额外的两次fcntl调用
+        int clientfd = accept4(m_listenfd, (sockaddr*)&caddr, &len, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (clientfd == -1) {
+            if (errno == EAGAIN || errno == EWOULDBLOCK) {//全连接队列已经取空
+                break;
+            }
+            if (errno == EINTR || errno == ECONNABORTED) {//被信号打断或者客户端已经放弃连接，继续接收
+                continue;
+            }
+            if ((errno == EMFILE || errno == ENFILE) && m_idlefd != -1) {
+                //文件描述符耗尽，先释放预留的文件描述符，接收一个连接后立即关闭，再重新预留
+                //否则连接一直留在队列中，边沿触发下不会再被通知，水平触发下会一直空转
+                //注意内核先分配文件描述符再检查队列，队列为空时同样返回EMFILE，所以取不到连接就退出
+                close(m_idlefd);
+                int dropfd = accept(m_listenfd, nullptr, nullptr);
+                if (dropfd != -1) {
+                    close(dropfd);
+                }
+                m_idlefd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+                if (dropfd == -1) {
+                    break;
+                }
+                LOG_WARN("\tToo many open files, drop new connection\n");
+                continue;
+            }
+            LOG_ERROR("\tAccept new connection failed\n");
+            break;
+        }
+        //连接表的容量来自RLIMIT_NOFILE，只有容量被MAX_CONN_TABLE_SIZE截断时才会超出
+        if (clientfd >= m_users->capacity()) {//不能在接入新的连接了，关闭新接入的客户端
+            close(clientfd);
+            continue;
+        }
+
+        LOG_DEBUG("\tNew connection: current client number:%d.  client: %s/%d\n", http_conn::m_user_count.load(), inet_ntoa(caddr.sin_addr), caddr.sin_port);
+        if (m_subloops != nullptr && !m_subloops->empty()) {//轮询交给子循环，连接此后固定由该子循环负责
+            EventLoop* sub = (*m_subloops)[m_next++ % m_subloops->size()];
+            sub->queueConn(clientfd, caddr);
+        }
+        else {//单reactor模式，由本循环自己处理
+            m_users->get(clientfd)->initNewConn(clientfd, caddr, this);
+        }
+        metrics.observe(HIST_ACCEPT, start, metrics.clock());
+        metrics.accepted();
+    }
+}
+
+bool EventLoop::overloaded() {
+    int depth = m_pool->get_queue_depth();
+    int watermark = m_throttled ? ACCEPT_LOW_WATERMARK : ACCEPT_HIGH_WATERMARK;//高低两个水位，避免在临界值附近反复切换
+    return depth * 100 >= m_pool->get_max_requests() * watermark;
+}
+
+void EventLoop::dispatch(http_conn* conn) {
+    conn->setStageTime(metrics.clock());//从这里开始计算在请求队列中等待的时间
+    conn->detachTimer();//工作线程交还连接时再放回
+    if (m_pool->appendtoPool(conn)) {
+        return;
+    }
+    //线程池已满，不能让连接停在这里：EPOLLONESHOT已经触发，不处理的话连接再也不会有事件
+    LOG_WARN("\tThread pool full, reject request\n");
+    conn->attachTimer();
+    if (!conn->rejectRequest()) {
+        conn->closeConn();
+    }
+}
+
+void EventLoop::handleWrite(http_conn* conn) {
+    if (!conn->writetoClient()) {
+        conn->closeConn();
+    }
+    else if (conn->hasPendingRequest()) {//客户端连续发送的下一个请求已经读到，直接交给工作线程
+        dispatch(conn);
+    }
+}
+
+void EventLoop::handleWakeup() {
+    uint64_t count = 0;
+    read(m_wakeupfd, &count, sizeof(count));
+
+    std::list<PendingConn> pending;
+    m_pendinglocker.lock();
+    pending.swap(m_pending);//一次性取出所有新连接和交还的连接，尽快释放锁
+    m_returning.swap(m_returned);
+    m_pendinglocker.unlock();
+    for (std::list<PendingConn>::iterator it = pending.begin(); it != pending.end(); ++it) {
+        m_users->get(it->sockfd)->initNewConn(it->sockfd, it->addr, this);
+    }
+
+    //交还的连接先放回定时器，响应直接发送，不用再等一轮EPOLLOUT
+    for (size_t i = 0; i < m_returning.size(); ++i) {
+        http_conn* conn = m_returning[i].conn;
+        if (conn->getGeneration() != m_returning[i].gen) {//连接已经关闭
+            continue;
+        }
+        conn->attachTimer();
+        if (m_returning[i].action == RETURN_READ) {
+            conn->waitRequest();
+        }
+        else if (m_returning[i].action == RETURN_WRITE) {
+            handleWrite(conn);
+        }
+        else {
+            conn->closeConn();
+        }
+    }
+    m_returning.clear();//保留容量，下次交换后给工作线程继续使用
+
+    //先处理完投递过来的新连接再开始排空，这些连接上的请求也会被处理
+    if (m_drain_request.exchange(false)) {
+        startDrain();
+    }
+}
+
+void EventLoop::handleSignal() {
+    struct signalfd_siginfo info;
+    while (read(m_sigfd, &info, sizeof(info)) == sizeof(info)) {
+        if (info.ssi_signo == SIGTERM || info.ssi_signo == SIGINT) {
+            LOG_INFO("\tReceive signal %d, start draining\n", (int)info.ssi_signo);
+            startDrain();
+        }
+    }
+}
+
+void EventLoop::handleHandoff() {
+    if (m_draining) {//已经在退出，不能再交接
+        return;
+    }
+    if (serveHandoff(m_handofffd, *m_listenfds)) {
+        LOG_INFO("\tListen sockets handed off to new process, start draining\n");
+        m_handed_off = true;
+        startDrain();
+    }
+    else {
+        LOG_ERROR("\tHandoff failed, keep serving\n");
+    }
+}
+
+/*
+    开始排空：停止接收新连接，关闭正在等待下一个请求的长连接，并通知子循环也开始排空；
+    正在读取请求或者发送响应的连接在响应完毕后由writetoClient关闭
+*/
+void EventLoop::startDrain() {
+    if (m_draining) {
+        return;
+    }
+    m_draining = true;
+    m_drain_deadline = timer_wheel::now() + DRAIN_TIMEOUT;
+    if (m_listenfd != -1) {//监听套接字由main关闭，交接后它在新进程中继续接收连接
+        epoll_ctl(m_epollfd, EPOLL_CTL_DEL, m_listenfd, 0);
+        m_listenfd = -1;
+        m_throttled = false;
+    }
+    if (m_handofffd != -1) {
+        epoll_ctl(m_epollfd, EPOLL_CTL_DEL, m_handofffd, 0);
+    }
+    if (m_subloops != nullptr) {
+        for (size_t i = 0; i < m_subloops->size(); ++i) {
+            (*m_subloops)[i]->queueDrain();
+        }
+    }
+    for (int fd = 0; fd < m_users->capacity(); ++fd) {//空闲的连接没有工作线程在处理，可以在本线程中直接关闭
+        http_conn* conn = m_users->find(fd);
+        if (conn == nullptr) {//整块都没有分配过，跳到下一块
+            fd += CONN_CHUNK_SIZE - 1 - fd % CONN_CHUNK_SIZE;
+            continue;
+        }
+        if (conn->getLoop() == this && conn->isIdle()) {
+            conn->closeConn();
+        }
+    }
+}
+
+void EventLoop::handleTimer() {
+    uint64_t count = 0;
+    read(m_timerfd, &count, sizeof(count));
+    m_armed = -1;//timerfd是一次性的，到期后需要重新设置
+    m_timer_wheel.tick();
+}
+
+//timerfd设置为时间轮中最近的到期时刻，只在这个时刻变化时才调用timerfd_settime
+void EventLoop::armTimer() {
+    long long next = m_timer_wheel.next_expire();
+    if (next == m_armed) {
+        return;
+    }
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (next != -1) {//没有定时器时全部为0，表示取消
+        its.it_value.tv_sec = next / 1000;
+        its.it_value.tv_nsec = (next % 1000) * 1000000;
+        if (its.it_value.tv_sec == 0 && its.it_value.tv_nsec == 0) {//0表示取消，至少设置为1纳秒
+            its.it_value.tv_nsec = 1;
+        }
+    }
+    timerfd_settime(m_timerfd, TFD_TIMER_ABSTIME, &its, nullptr);//使用单调时钟的绝对时间，与时间轮一致
+    m_armed = next;
+}
+
+void EventLoop::loop() {
+    struct epoll_event events[MAX_EVENT_NUMBER];//创建最大可监听事件数量的数组
+    while (true) {
+        //暂停接收新连接时定期醒来检查请求队列深度，排空时定期检查连接是否全部关闭，否则一直阻塞等待
+        int wait_ms = m_throttled ? ACCEPT_RETRY : (m_draining ? DRAIN_CHECK : -1);
+        int recnum = epoll_wait(m_epollfd, events, MAX_EVENT_NUMBER, wait_ms);
+        if (( recnum < 0 ) && ( errno != EINTR ) ) {//失败,或者因为中断而造成的错误
+            LOG_ERROR("\there wrong!\n");
+            continue;
+        }
+
+        bool timeout = false;//是否有定时任务需要处理
+        for (int i = 0; i < recnum; ++i) {
+            int curfd = (int)(uint32_t)events[i].data.u64;//获取当前文件描述符
+            uint32_t gen = events[i].data.u64 >> 32;//连接的代数，不是连接时为0
+
+            if (curfd == m_listenfd) {//说明有客户端接入
+                handleAccept();
+            }
+            else if (curfd == m_wakeupfd) {//其他线程投递了新连接或者工作线程交还了连接
+                handleWakeup();
+            }
+            else if (curfd == m_timerfd) {//时间轮中有定时器到期
+                timeout = true;
+            }
+            else if (curfd == m_notifyfd) {//缓存的文件被修改
+                filecache.handleNotify();
+            }
+            else if (curfd == m_sigfd) {//SIGTERM或SIGINT
+                handleSignal();
+            }
+            else if (curfd == m_handofffd) {//新进程请求接管监听套接字
+                handleHandoff();
+            }
+            else {
+                http_conn* conn = m_users->find(curfd);
+                //连接已经关闭，文件描述符又被新连接使用，这是旧连接的过期事件
+                if (conn == nullptr || conn->getGeneration() != gen) {
+                    continue;
+                }
+                if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {//客户端已关闭
+                    conn->closeConn();
+                }
+                else if (events[i].events & EPOLLIN) {//检测到读事件
+                    uint64_t start = metrics.clock();
+                    bool read_ret = conn->readRequest();
+                    metrics.observe(HIST_READ, start, metrics.clock());
+                    if (read_ret) {//一次性读取所有数据，然后将数据传递给工作线程
+                        LOG_TRACE("\tRead accessed!\n");
+                        dispatch(conn);
+                    }
+                    else {//如果读取数据失败了，则要关闭这个连接
+                        LOG_DEBUG("\tRead failed!\n");
+                        conn->closeConn();
+                    }
+                }
+                else if (events[i].events & EPOLLOUT) {//检测到写事件
+                    handleWrite(conn);
+                }
+            }
+        }
+        //最后处理定时事件，因为I/O事件有更高优先级，timerfd精度为毫秒，延迟最多为处理一批事件的时间
+        if (timeout) {
+            handleTimer();
+        }
+        armTimer();//本轮事件可能添加或刷新了定时器
+        if (m_throttled && !overloaded()) {//请求队列已经降到低水位，取出积压在全连接队列中的连接
+            m_throttled = false;
+            LOG_INFO("\tThread pool recovered, resume accepting\n");
+            handleAccept();
+        }
+        if (m_draining) {
+            if (http_conn::m_user_count == 0) {
+                break;
+            }
+            if (timer_wheel::now() >= m_drain_deadline) {
+                LOG_WARN("\tDrain timeout, %d connections left\n", http_conn::m_user_count.load());
+                break;
+            }
+        }
+    }
+}
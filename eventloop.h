@@ -0,0 +1,116 @@
+/*
+    本程序是对事件循环进行封装，一个事件循环拥有一个epoll实例和一个线程
+    多reactor模式下：主循环负责接收新连接，并把连接轮询分配给子循环，
+    每个连接在整个生命周期内固定由一个子循环负责读写，从而让网络I/O分散到多个核上
+    工作线程处理完请求后把连接交还给所属的循环，定时器、事件注册和关闭连接都只在循环的线程中进行
+    退出时进入排空模式：停止接收新连接，关闭空闲的长连接，正在处理的请求响应完毕后关闭连接，
+    所有连接关闭或者超过DRAIN_TIMEOUT后事件循环返回
+*/
+#ifndef EVENTLOOP_H
+#define EVENTLOOP_H
+
+#include <pthread.h>
+#include <list>
+#include <vector>
+#include <atomic>
+#include <sys/epoll.h>
+#include <arpa/inet.h>
+#include "locker.h"
+#include "threadpool.h"
+#include "timer_wheel.h"
+
+#define MAX_EVENT_NUMBER 500  // 监听的最大的事件数量
+#define ACCEPT_HIGH_WATERMARK 80 // 请求队列深度达到上限的百分之多少时暂停接收新连接
+#define ACCEPT_LOW_WATERMARK 50 // 暂停后请求队列深度降到上限的百分之多少以下时恢复接收
+#define ACCEPT_RETRY 10 // 暂停接收期间检查请求队列深度的间隔，单位毫秒
+#define DRAIN_TIMEOUT 30000 // 排空模式下等待已有请求处理完毕的最长时间，单位毫秒
+#define DRAIN_CHECK 100 // 排空模式下检查连接是否全部关闭的间隔，单位毫秒
+
+class http_conn;
+class ConnTable;
+
+//工作线程处理完请求后事件循环要做的事：继续读取请求的剩余数据、发送响应、关闭连接
+enum RETURN_ACTION {RETURN_READ = 0, RETURN_WRITE, RETURN_CLOSE};
+
+class EventLoop {
+public:
+    EventLoop();//构造函数
+    ~EventLoop();//析构函数
+
+    bool init(int index, ConnTable* users, ThreadPool<http_conn>* pool);//创建epoll实例和唤醒描述符
+    void setListenFd(int listenfd);//由本循环负责接收新连接，监听套接字必须是非阻塞的
+    void setNotifyFd(int notifyfd);//由本循环负责处理文件缓存的inotify事件
+    void setSignalFd(int sigfd);//由本循环负责处理signalfd，收到SIGTERM或SIGINT时开始排空
+    void setHandoffFd(int handofffd, std::vector<int>* listenfds);//由本循环负责把监听套接字交接给新进程
+    void setSubLoops(std::vector<EventLoop*>* loops);//设置子循环，设置后新连接交给子循环处理
+    bool startThread();//创建线程运行事件循环
+    void loop();//在当前线程中运行事件循环，排空完毕后返回
+    void join();//等待startThread创建的线程结束
+
+    void queueConn(int sockfd, const sockaddr_in& addr);//其他线程把新连接交给本循环，线程安全
+    void queueDrain();//其他线程通知本循环开始排空，线程安全
+    void returnConn(http_conn* conn, int action);//工作线程把处理完的连接交还给所属的事件循环，线程安全
+    bool isDraining() { return m_draining; }//工作线程也会读取
+    bool handedOff() { return m_handed_off; }//监听套接字是否已经交给新进程
+
+    int getEpollfd() { return m_epollfd; }
+    timer_wheel* getTimerWheel() { return &m_timer_wheel; }
+
+private:
+    static void* work(void* arg);
+    void wakeup();//唤醒阻塞在epoll_wait上的循环
+    void handleAccept();//接收新连接
+    void handleWakeup();//处理其他线程投递过来的连接和排空通知
+    void handleSignal();//处理signalfd中的信号
+    void handleHandoff();//处理新进程的交接请求
+    void startDrain();//开始排空，只在本循环的线程中调用
+    void handleTimer();//处理到期的定时器
+    void armTimer();//按时间轮中最近的到期时刻设置timerfd
+    void dispatch(http_conn* conn);//把读到请求的连接交给线程池，线程池已满时直接回复503
+    void handleWrite(http_conn* conn);//发送响应，发送完毕后缓冲区中还有请求时再交给线程池
+    bool overloaded();//请求队列深度是否达到暂停接收新连接的水位
+
+private:
+    struct PendingConn {//等待交给本循环的新连接
+        int sockfd;
+        sockaddr_in addr;
+    };
+    struct ReturnedConn {//工作线程交还的连接
+        http_conn* conn;
+        uint32_t gen;//交还时连接的代数
+        int action;//RETURN_ACTION
+    };
+
+    int m_index;//循环编号，也用于绑定CPU核
+    int m_epollfd;//本循环独占的epoll实例
+    int m_wakeupfd;//eventfd，用于跨线程唤醒
+    int m_listenfd;//监听套接字，-1表示本循环不负责接收连接
+    int m_idlefd;//预留的空闲文件描述符，文件描述符耗尽时用它接收并关闭新连接
+    bool m_throttled;//线程池过载，暂停接收新连接，新连接留在内核的全连接队列中
+    int m_timerfd;//本循环的timerfd，到期时处理时间轮
+    long long m_armed;//timerfd当前设置的到期时刻（单调时钟，毫秒），-1表示没有设置
+    int m_notifyfd;//文件缓存的inotify描述符，-1表示本循环不处理
+    int m_sigfd;//signalfd，-1表示本循环不处理信号
+    int m_handofffd;//接收交接请求的Unix域套接字，-1表示本循环不处理
+    std::vector<int>* m_listenfds;//进程的所有监听套接字，交接时发给新进程
+    pthread_t m_thread;
+
+    ConnTable* m_users;//所有循环共享的连接表，按文件描述符索引
+    ThreadPool<http_conn>* m_pool;//工作线程池
+    std::vector<EventLoop*>* m_subloops;//子循环，为空时本循环自己处理新连接
+    unsigned int m_next;//下一个接收新连接的子循环
+
+    timer_wheel m_timer_wheel;//本循环上所有连接的定时器，只在本循环的线程中操作
+
+    std::atomic<bool> m_draining;//是否处于排空模式
+    std::atomic<bool> m_drain_request;//其他线程请求开始排空
+    long long m_drain_deadline;//排空的截止时刻（单调时钟，毫秒）
+    bool m_handed_off;//监听套接字已经交给新进程
+
+    std::list<PendingConn> m_pending;//其他线程投递过来的新连接
+    std::vector<ReturnedConn> m_returned;//工作线程交还的连接
+    std::vector<ReturnedConn> m_returning;//正在处理的交还连接，与m_returned交换，只在本循环的线程中使用
+    Locker m_pendinglocker;//保护m_pending和m_returned
+};
+
+#endif
@@ -0,0 +1,224 @@
+#include <fcntl.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <sys/inotify.h>
+#include "filecache.h"
+#include "httpresp.h"
+#include "mimetype.h"
+
+FileCache::FileCache() : m_budget(0), m_bytes(0), m_notifyfd(-1) {}
+
+FileCache::~FileCache() {
+    for (std::unordered_map<std::string, CachedFile*>::iterator it = m_files.begin(); it != m_files.end(); ++it) {
+        close(it->second->fd);
+        delete it->second;
+    }
+    m_files.clear();
+    m_lru.clear();
+    if (m_notifyfd != -1) {
+        close(m_notifyfd);
+    }
+}
+
+bool FileCache::init(size_t budget) {
+    m_budget = budget;
+    if (m_budget == 0) {//不缓存，每次请求都打开文件
+        return true;
+    }
+    //inotify失败时不影响缓存使用，只是命中时要用stat校验文件是否被修改
+    m_notifyfd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    return true;
+}
+
+//两次stat得到的是否是同一个没有修改过的文件
+static bool same_file(const struct stat& a, const struct stat& b) {
+    return a.st_ino == b.st_ino && a.st_size == b.st_size
+        && a.st_mtim.tv_sec == b.st_mtim.tv_sec && a.st_mtim.tv_nsec == b.st_mtim.tv_nsec;
+}
+
+//打开文件并读取状态，返回的缓存项引用计数为1
+//先打开再fstat，状态一定属于打开的文件；目录不能发送，不打开也不缓存，err为EISDIR
+CachedFile* FileCache::load(const char* path, int* err) {
+    CachedFile* file = new CachedFile;
+    file->path = path;
+    file->refcount = 1;
+    file->cached = false;
+    file->fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (file->fd == -1) {//文件不存在等
+        *err = errno;
+        delete file;
+        return nullptr;
+    }
+    int ret = fstat(file->fd, &file->st);
+    if (ret < 0 || S_ISDIR(file->st.st_mode)) {
+        *err = (ret < 0) ? errno : EISDIR;
+        close(file->fd);
+        delete file;
+        return nullptr;
+    }
+    //文件内容不变时这些头部也不变，文件被修改后缓存项失效，重新打开时再生成
+    char etag[MAX_ETAG_LEN + 1];
+    char date[HTTP_DATE_LEN + 1];
+    format_etag(file->st, etag);
+    format_http_date(file->st.st_mtime, date);
+    file->etag = etag;
+    file->last_modified = date;
+    file->content_type = std::string("Content-Type: ") + lookup_mime_type(file->path) + "\r\n";
+    file->validators = "Accept-Ranges: bytes\r\nETag: " + file->etag + "\r\nLast-Modified: " + file->last_modified + "\r\n";
+    return file;
+}
+
+CachedFile* FileCache::acquire(const char* path, int* err) {
+    m_locker.lock();
+    std::unordered_map<std::string, CachedFile*>::iterator it = m_files.find(path);
+    if (it != m_files.end()) {
+        CachedFile* file = it->second;
+        bool fresh = true;
+        if (m_notifyfd == -1) {//没有inotify，按inode、大小和修改时间校验
+            struct stat st;
+            fresh = stat(path, &st) == 0 && same_file(st, file->st);
+        }
+        if (fresh) {//命中缓存，移动到LRU链表头部
+            ++file->refcount;
+            m_lru.splice(m_lru.begin(), m_lru, file->lru);
+            m_locker.unlock();
+            return file;
+        }
+        invalidate(file);
+    }
+    m_locker.unlock();
+
+    //未命中，在锁外打开文件，避免阻塞其他线程
+    CachedFile* file = load(path, err);
+    if (file == nullptr) {
+        return nullptr;
+    }
+    if (m_budget == 0 || (size_t)file->st.st_size > m_budget) {//不缓存或者文件超过整个预算，用完即关闭；空文件不占预算，照常缓存
+        return file;
+    }
+
+    m_locker.lock();
+    it = m_files.find(path);
+    if (it != m_files.end()) {//其他线程已经把同一个文件放入缓存，使用已有的缓存项
+        CachedFile* cached = it->second;
+        ++cached->refcount;
+        m_lru.splice(m_lru.begin(), m_lru, cached->lru);
+        m_locker.unlock();
+        close(file->fd);
+        delete file;
+        return cached;
+    }
+    file->cached = true;
+    m_files[file->path] = file;
+    m_lru.push_front(file);
+    file->lru = m_lru.begin();
+    m_bytes += file->st.st_size;
+    /*
+        load在锁外执行，开始监听之前文件被修改不会有事件，监听之后、放入缓存之前的事件也找不到缓存项；
+        所以先放入缓存并开始监听，再stat一次，与打开时的状态不同就立即失效，之后的修改都能收到事件
+    */
+    if (m_notifyfd != -1) {
+        watchDir(file->path);
+        struct stat st;
+        if (stat(file->path.c_str(), &st) < 0 || !same_file(st, file->st)) {
+            invalidate(file);//调用者仍然持有引用，用完后关闭
+            m_locker.unlock();
+            return file;
+        }
+    }
+
+    //超过预算或者文件数量上限，从LRU链表尾部开始淘汰
+    while ((m_bytes > m_budget || m_files.size() > MAX_CACHED_FILES) && m_lru.back() != file) {
+        invalidate(m_lru.back());
+    }
+    m_locker.unlock();
+    return file;
+}
+
+void FileCache::release(CachedFile* file) {
+    m_locker.lock();
+    unref(file);
+    m_locker.unlock();
+}
+
+void FileCache::unref(CachedFile* file) {
+    --file->refcount;
+    if (file->refcount == 0 && !file->cached) {//已经不在缓存中，最后一个使用者负责关闭
+        close(file->fd);
+        delete file;
+    }
+}
+
+void FileCache::invalidate(CachedFile* file) {
+    m_files.erase(file->path);
+    m_lru.erase(file->lru);
+    m_bytes -= file->st.st_size;
+    file->cached = false;
+    ++file->refcount;//借用unref统一处理关闭
+    unref(file);
+}
+
+void FileCache::invalidateDir(const std::string& dir) {
+    std::string prefix = dir + "/";
+    std::list<CachedFile*> victims;
+    for (std::list<CachedFile*>::iterator it = m_lru.begin(); it != m_lru.end(); ++it) {
+        if ((*it)->path.compare(0, prefix.size(), prefix) == 0) {
+            victims.push_back(*it);
+        }
+    }
+    for (std::list<CachedFile*>::iterator it = victims.begin(); it != victims.end(); ++it) {
+        invalidate(*it);
+    }
+}
+
+void FileCache::watchDir(const std::string& path) {
+    if (m_notifyfd == -1) {
+        return;
+    }
+    std::string dir = path.substr(0, path.rfind('/'));
+    //同一个目录重复添加时inotify返回相同的监听描述符，只是更新监听的事件
+    int wd = inotify_add_watch(m_notifyfd, dir.c_str(), IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_DELETE
+        | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF);
+    if (wd != -1) {
+        m_dirs[wd] = dir;
+    }
+}
+
+void FileCache::handleNotify() {
+    char buf[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+    while (true) {
+        int len = read(m_notifyfd, buf, sizeof(buf));
+        if (len <= 0) {//EAGAIN，事件已经读完
+            break;
+        }
+        m_locker.lock();
+        for (char* ptr = buf; ptr < buf + len; ptr += sizeof(struct inotify_event) + ((struct inotify_event*)ptr)->len) {
+            const struct inotify_event* event = (const struct inotify_event*)ptr;
+            if (event->mask & IN_Q_OVERFLOW) {//事件队列溢出，无法知道哪些文件被修改，全部失效
+                while (!m_lru.empty()) {
+                    invalidate(m_lru.back());
+                }
+                continue;
+            }
+            std::unordered_map<int, std::string>::iterator dir = m_dirs.find(event->wd);
+            if (dir == m_dirs.end()) {
+                continue;
+            }
+            if (event->mask & (IN_DELETE_SELF | IN_MOVE_SELF | IN_IGNORED)) {//目录本身被删除或移动
+                invalidateDir(dir->second);
+                if (event->mask & IN_IGNORED) {
+                    m_dirs.erase(dir);
+                }
+                continue;
+            }
+            if (event->len > 0) {//目录下的某个文件被修改
+                std::unordered_map<std::string, CachedFile*>::iterator it = m_files.find(dir->second + "/" + event->name);
+                if (it != m_files.end()) {
+                    invalidate(it->second);
+                }
+            }
+        }
+        m_locker.unlock();
+    }
+}
@@ -0,0 +1,65 @@
+/*
+    本程序实现进程内共享的文件缓存
+    按完整路径缓存打开的文件描述符和stat信息，热门曲目命中缓存后不再需要stat、open、close等系统调用；
+    缓存项带引用计数，正在发送的文件即使被淘汰也要等最后一个使用者释放后才关闭；
+    总字节数超过预算时按LRU淘汰，文件被修改或删除时由inotify通知失效，inotify不可用时退化为按mtime校验
+*/
+#ifndef FILECACHE_H
+#define FILECACHE_H
+
+#include <sys/stat.h>
+#include <string>
+#include <list>
+#include <unordered_map>
+#include "locker.h"
+
+#define MAX_CACHED_FILES 256 // 缓存的最大文件数量，每个缓存项都占用一个文件描述符
+
+//一个缓存的文件，由FileCache管理，使用者只读
+struct CachedFile {
+    std::string path;//文件完整路径，也是缓存的键
+    int fd;//只读打开的文件描述符，sendfile使用显式偏移，多个连接可以共享
+    struct stat st;//打开时的文件状态
+    std::string etag;//ETag，打开时生成一次，If-Range比较时使用
+    std::string last_modified;//Last-Modified，HTTP时间格式
+    std::string content_type;//预先生成的Content-Type头部，按扩展名查找一次
+    std::string validators;//预先生成的Accept-Ranges、ETag和Last-Modified头部，每个响应直接复制
+    int refcount;//正在使用的连接数量，由缓存的锁保护
+    bool cached;//是否还在缓存中，被淘汰或失效后为false，引用计数归零时关闭
+    std::list<CachedFile*>::iterator lru;//在LRU链表中的位置
+};
+
+class FileCache {
+public:
+    FileCache();//构造函数
+    ~FileCache();//析构函数
+
+    //初始化缓存，budget为缓存文件的总字节数上限，0表示不缓存
+    bool init(size_t budget);
+    //获取path对应的文件，引用计数加1，失败返回nullptr，err保存errno
+    CachedFile* acquire(const char* path, int* err);
+    //使用完毕，引用计数减1
+    void release(CachedFile* file);
+    //inotify文件描述符，由事件循环监听，-1表示inotify不可用
+    int getNotifyFd() { return m_notifyfd; }
+    //处理inotify事件，使被修改的文件失效
+    void handleNotify();
+
+private:
+    CachedFile* load(const char* path, int* err);//打开文件并读取状态
+    void watchDir(const std::string& path);//监听文件所在的目录
+    void invalidate(CachedFile* file);//从缓存中移除，加锁后调用
+    void invalidateDir(const std::string& dir);//目录下的所有文件失效，加锁后调用
+    void unref(CachedFile* file);//引用计数减1，归零且不在缓存中时关闭，加锁后调用
+
+private:
+    size_t m_budget;//缓存的总字节数上限
+    size_t m_bytes;//当前缓存的总字节数
+    int m_notifyfd;//inotify文件描述符
+    std::unordered_map<std::string, CachedFile*> m_files;//路径到缓存项
+    std::list<CachedFile*> m_lru;//最近使用的在前面
+    std::unordered_map<int, std::string> m_dirs;//inotify监听描述符到目录
+    Locker m_locker;//多个事件循环和工作线程共享缓存，必须加锁
+};
+
+#endif
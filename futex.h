@@ -0,0 +1,53 @@
+#ifndef FUTEX_H
+#define FUTEX_H
+
+/*
+    本程序实现对futex的封装，用于线程空闲时的休眠和唤醒
+    与信号量不同，唤醒方只有在确实有线程休眠时才需要进入内核
+*/
+#include <atomic>
+#include <limits.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#include <linux/futex.h>
+
+class Futex {
+
+public:
+    Futex () : m_word(0) {}
+
+    //读取当前的序号，之后再检查条件，条件不满足时用这个序号调用wait
+    int prepare () {
+        return m_word.load();
+    }
+
+    //序号仍然等于seq时休眠，期间有wake调用则立即返回，避免丢失唤醒
+    void wait (int seq) {
+        syscall(SYS_futex, (int*)&m_word, FUTEX_WAIT_PRIVATE, seq, nullptr, nullptr, 0);
+    }
+
+    //唤醒最多count个休眠的线程
+    void wake (int count) {
+        m_word.fetch_add(1);
+        syscall(SYS_futex, (int*)&m_word, FUTEX_WAKE_PRIVATE, count, nullptr, nullptr, 0);
+    }
+
+    void wakeAll () {
+        wake(INT_MAX);
+    }
+
+private:
+    std::atomic<int> m_word;//每次唤醒加1，休眠的线程据此判断期间是否有唤醒
+
+};
+
+//自旋等待时让出流水线，减少对另一个超线程的影响
+inline void cpu_relax () {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    asm volatile("yield");
+#endif
+}
+
+#endif
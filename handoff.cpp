@@ -0,0 +1,141 @@
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+#include <unistd.h>
+#include <string.h>
+#include <errno.h>
+#include "handoff.h"
+#include "logging.h"
+
+static bool fillAddr(const char* path, sockaddr_un* addr) {
+    if (strlen(path) >= sizeof(addr->sun_path)) {
+        return false;
+    }
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    strcpy(addr->sun_path, path);
+    return true;
+}
+
+//交接过程是阻塞的，设置超时防止对方异常时一直卡住
+static void setTimeout(int fd) {
+    struct timeval tv;
+    tv.tv_sec = HANDOFF_TIMEOUT;
+    tv.tv_usec = 0;
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+}
+
+int createHandoffListener(const char* path) {
+    sockaddr_un addr;
+    if (!fillAddr(path, &addr)) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    unlink(path);//旧进程（如果有）已经交接完毕，它的套接字文件可以删除
+    if (bind(fd, (const sockaddr*)&addr, sizeof(addr)) == -1 || listen(fd, 1) == -1) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int requestHandoff(const char* path, int expected, std::vector<int>* fds) {
+    sockaddr_un addr;
+    if (!fillAddr(path, &addr)) {
+        return -1;
+    }
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd == -1) {
+        return -1;
+    }
+    if (connect(fd, (const sockaddr*)&addr, sizeof(addr)) == -1) {//没有旧进程在运行
+        close(fd);
+        return (errno == ENOENT || errno == ECONNREFUSED) ? 0 : -1;
+    }
+    setTimeout(fd);
+
+    //消息内容是监听套接字的个数，套接字本身放在控制消息中
+    int count = 0;
+    char control[CMSG_SPACE(sizeof(int) * MAX_HANDOFF_FDS)];
+    struct iovec iov;
+    iov.iov_base = &count;
+    iov.iov_len = sizeof(count);
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control;
+    msg.msg_controllen = sizeof(control);
+    if (recvmsg(fd, &msg, MSG_CMSG_CLOEXEC) != sizeof(count)) {
+        close(fd);
+        return -1;
+    }
+
+    fds->clear();
+    for (struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg); cmsg != nullptr; cmsg = CMSG_NXTHDR(&msg, cmsg)) {
+        if (cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+            int n = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+            int* received = (int*)CMSG_DATA(cmsg);
+            for (int i = 0; i < n; ++i) {
+                fds->push_back(received[i]);
+            }
+        }
+    }
+
+    //数量不一致说明新旧进程的监听配置不同（例如-s和-r参数不同），拒绝接管，旧进程继续服务
+    char ack = ((int)fds->size() == count && count == expected) ? 'Y' : 'N';
+    if (ack == 'N') {
+        LOG_WARN("\tHandoff expects %d listen sockets, got %d\n", expected, (int)fds->size());
+    }
+    bool sent = send(fd, &ack, 1, 0) == 1;
+    close(fd);
+    if (ack == 'N' || !sent) {
+        for (size_t i = 0; i < fds->size(); ++i) {
+            close((*fds)[i]);
+        }
+        fds->clear();
+        return -1;
+    }
+    return 1;
+}
+
+bool serveHandoff(int handofffd, const std::vector<int>& fds) {
+    int fd = accept4(handofffd, nullptr, nullptr, SOCK_CLOEXEC);
+    if (fd == -1) {
+        return false;
+    }
+    setTimeout(fd);
+
+    int count = fds.size();
+    if (count > MAX_HANDOFF_FDS) {
+        close(fd);
+        return false;
+    }
+    char control[CMSG_SPACE(sizeof(int) * MAX_HANDOFF_FDS)];
+    memset(control, 0, sizeof(control));
+    struct iovec iov;
+    iov.iov_base = &count;
+    iov.iov_len = sizeof(count);
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    if (count > 0) {
+        msg.msg_control = control;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * count);
+        struct cmsghdr* cmsg = CMSG_FIRSTHDR(&msg);
+        cmsg->cmsg_level = SOL_SOCKET;
+        cmsg->cmsg_type = SCM_RIGHTS;
+        cmsg->cmsg_len = CMSG_LEN(sizeof(int) * count);
+        memcpy(CMSG_DATA(cmsg), fds.data(), sizeof(int) * count);
+    }
+
+    char ack = 'N';
+    bool ok = sendmsg(fd, &msg, 0) == sizeof(count) && recv(fd, &ack, 1, 0) == 1 && ack == 'Y';
+    close(fd);
+    return ok;
+}
@@ -0,0 +1,27 @@
+/*
+    本程序实现热重启时监听套接字的交接
+    旧进程在一个Unix域套接字上等待；新进程启动时连接这个套接字，
+    旧进程用SCM_RIGHTS把所有监听套接字发给新进程，新进程确认后旧进程停止接收新连接并处理完已有的请求后退出，
+    监听套接字在内核中一直存在，全连接队列中的连接不会丢失，部署时不会拒绝任何连接
+*/
+#ifndef HANDOFF_H
+#define HANDOFF_H
+
+#include <vector>
+
+#define MAX_HANDOFF_FDS 64 // 一次交接的最大监听套接字数量
+#define HANDOFF_TIMEOUT 5 // 交接过程中等待对方的最长时间，单位秒
+
+//在path上创建接收交接请求的Unix域套接字，返回非阻塞的监听套接字，失败返回-1
+int createHandoffListener(const char* path);
+
+/*
+    新进程调用：连接path上的旧进程并接收监听套接字，数量必须等于expected
+    返回1表示已经接管，监听套接字保存在fds中；返回0表示没有旧进程在运行；返回-1表示交接失败
+*/
+int requestHandoff(const char* path, int expected, std::vector<int>* fds);
+
+//旧进程调用：从handofffd接收一个交接请求，把fds发给新进程，新进程确认接管后返回true
+bool serveHandoff(int handofffd, const std::vector<int>& fds);
+
+#endif
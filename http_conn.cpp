@@ -1,14 +1,22 @@
 #include "http_conn.h"
-#include "sort_timer_list.h"
-#include "_freecplus.h"
+#include "timer_wheel.h"
+#include "eventloop.h"
+#include "bufpool.h"
+#include "httpscan.h"
+#include "httpresp.h"
+#include "httprange.h"
+#include "accesslog.h"
+#include "metrics.h"
+#include "logging.h"
 
-#define TIMESLOT 5
-
-extern CLogFile logfile;
-static sort_timer_list timer_lst;
+extern FileCache filecache;
+extern BufPool bufpool;
+extern AccessLog accesslog;
+extern Metrics metrics;
 
 // 定义HTTP响应的一些状态信息
-const char* ok_200_title = "OK";
+const char* status_200_line = "HTTP/1.1 200 OK\r\n";
+const char* status_206_line = "HTTP/1.1 206 Partial Content\r\n";
 const char* error_400_title = "Bad Request";
 const char* error_400_form = "Your request has bad syntax or is inherently impossible to satisfy.\n";
 const char* error_403_title = "Forbidden";
@@ -17,6 +25,46 @@ const char* error_404_title = "Not Found";
 const char* error_404_form = "The requested file was not found on this server.\n";
 const char* error_500_title = "Internal Error";
 const char* error_500_form = "There was an unusual problem serving the requested file.\n";
+const char* error_416_title = "Range Not Satisfiable";
+const char* error_416_form = "The requested range is not satisfiable.\n";
+const char* error_431_title = "Request Header Fields Too Large";
+const char* error_431_form = "The request header fields are too large.\n";
+const char* error_503_title = "Service Unavailable";
+const char* error_503_form = "The server is overloaded, please retry later.\n";
+
+//multipart/byteranges响应中各个范围之间的分隔符，以及用它预先拼好的分隔行和Content-Type头部
+#define BYTERANGES_BOUNDARY "00000000000000000416"
+const char* byteranges_part = "\r\n--" BYTERANGES_BOUNDARY "\r\n";
+const char* byteranges_tail = "\r\n--" BYTERANGES_BOUNDARY "--\r\n";
+const char* byteranges_type = "Content-Type: multipart/byteranges; boundary=" BYTERANGES_BOUNDARY "\r\n";
+
+//运行统计的Content-Type，Prometheus文本格式
+const char* metrics_type = "Content-Type: text/plain; version=0.0.4; charset=utf-8\r\n";
+
+/*
+    预先生成的错误响应：状态行、Content-Type和Content-Length在启动时拼好，消息体是固定的文本，
+    发送时只在后面追加Connection、Date和少数几个与请求有关的头部，不再逐个格式化
+*/
+struct error_response {
+    std::string head;//状态行、Content-Type和Content-Length
+    std::string_view body;
+};
+
+static error_response make_error_response(int status, const char* title, const char* form) {
+    error_response resp;
+    resp.body = form;
+    resp.head = "HTTP/1.1 " + std::to_string(status) + " " + title + "\r\n"
+        + "Content-Type: text/html\r\nContent-Length: " + std::to_string(resp.body.size()) + "\r\n";
+    return resp;
+}
+
+static const error_response error_400 = make_error_response(400, error_400_title, error_400_form);
+static const error_response error_403 = make_error_response(403, error_403_title, error_403_form);
+static const error_response error_404 = make_error_response(404, error_404_title, error_404_form);
+static const error_response error_416 = make_error_response(416, error_416_title, error_416_form);
+static const error_response error_431 = make_error_response(431, error_431_title, error_431_form);
+static const error_response error_500 = make_error_response(500, error_500_title, error_500_form);
+static const error_response error_503 = make_error_response(503, error_503_title, error_503_form);
 
 //网站根目录
 const char* doc_root = "/root/Lcs/network/mynetwork/buildwebsever/resources";
@@ -42,19 +90,24 @@ socket 上又有新数据可读（EPOLLIN 再次被触发），此时另外一
 socket 上的 EPOLLONESHOT 事件，以确保这个 socket 下一次可读时，其 EPOLLIN 事件能被触发，进
 而让其他工作线程有机会继续处理这个 socket。
 */
+//epoll事件的用户数据：低32位为文件描述符，高32位为连接的代数，不是连接的描述符代数为0
+//文件描述符关闭后马上被新连接复用时，事件循环用代数识别出属于旧连接的过期事件
+static uint64_t event_data (int fd, uint32_t gen) {
+    return ((uint64_t)gen << 32) | (uint32_t)fd;
+}
 //添加文件描述符
-void adfd (int epollfd, int fd, bool oneshoot) {//第三个参数的意义如上所述
+//传入的文件描述符必须已经是非阻塞的（accept4、socket、eventfd等创建时直接指定），这里不再调用fcntl设置
+void adfd (int epollfd, int fd, bool oneshoot, bool et, uint32_t gen = 0) {//第三个参数的意义如上所述，et表示是否使用边沿触发
     epoll_event event;
-    event.data.fd = fd;
+    event.data.u64 = event_data(fd, gen);
     event.events = EPOLLIN | EPOLLRDHUP;    // 监控读事件和连接关闭
     if (oneshoot) {
         event.events |= EPOLLONESHOT;
     }
+    if (et) {
+        event.events |= EPOLLET;
+    }
     epoll_ctl(epollfd, EPOLL_CTL_ADD, fd, &event);//向内核中的epollfd中添加要监听的文件描述符
-    /*
-        这里需要将文件描述符设置为非阻塞状态才能实现epoll的高效使用，为什么呢？原理还不太清楚，后面查一下，一下子没找到！！！！
-    */
-    setNoBlock(fd);//将文件描述符设置为非阻塞状态
 }
 //移除文件描述符
 void removefd (int epollfd, int fd) {//移除需要监听的文件描述符
@@ -63,81 +116,97 @@ void removefd (int epollfd, int fd) {//移除需要监听的文件描述符
     close(fd);//关闭文件描述符
 }
 //修改文件描述符
-void modfd (int epollfd, int fd, int ev) {//修改文件描述符
+void modfd (int epollfd, int fd, int ev, uint32_t gen) {//修改文件描述符
     epoll_event event;
-    event.data.fd = fd;
+    event.data.u64 = event_data(fd, gen);
     event.events = ev | EPOLLET | EPOLLONESHOT | EPOLLRDHUP;//添加新事件
     epoll_ctl(epollfd, EPOLL_CTL_MOD, fd, &event);//修改事件属性
 }
 
 //初始化客户数量
-int http_conn::m_user_count = 0;//开始时候为0,类外初始化
-//初始化socket上的事件都被注册到同一个epoll内核事件中，所以设置成静态
-int http_conn::m_epollfd = -1;//初始化内核事件文件描述符
+std::atomic<int> http_conn::m_user_count(0);//开始时候为0,类外初始化
 
-//关闭连接
+//单调时钟的微秒数
+static uint64_t now_us () {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+/*
+    关闭连接
+    套接字必须最后关闭：关闭以后这个文件描述符可能立即被主循环接收的新连接使用，
+    新连接会在另一个子循环中用同一个对象调用initNewConn，之后不能再修改这个对象
+*/
 void http_conn::closeConn () {
     if (m_sockfd != -1) {//这个工作的通信套接字
-        removefd(m_epollfd, m_sockfd);//从共享的内核事件文件描述符中移除当前通信描述符
         utill_timer* timer = m_timer;
         m_timer = nullptr;
-        if (!timer_lst.isEmpty()) {
-            timer_lst.del_timer(timer);
-        }  
+        m_timer_wheel->del_timer(timer);//定时器到期时已经从时间轮中摘下，这里只释放
+        log_access();//响应没有发送完连接就关闭了，也要记录
+        closeFile();//连接中途关闭时释放正在发送的文件
+        free_read_buf();
+        free_write_buf();
+        int sockfd = m_sockfd;
         m_sockfd = -1;//将通信套接字设置为-1，表示无通信描述符占用
+        //同一批事件中这个连接后面的事件都变成过期事件，例如排空时关闭的空闲连接恰好也有EPOLLIN
+        next_generation();
         --m_user_count;//关闭一个连接当然通信描述符-1
+        removefd(m_epollfd, sockfd);//从所属事件循环的epoll中移除当前通信描述符并关闭
     }
 }
 
-void timer_handler () {
-    //定时处理任务，实际上就是调用tick()函数
-    timer_lst.tick();
+void http_conn::next_generation () {
+    uint32_t gen = m_generation.load(std::memory_order_relaxed) + 1;
+    m_generation.store((gen == 0) ? 1 : gen, std::memory_order_relaxed);//0留给不是连接的描述符
 }
 
+//回调函数，连接超时后关闭连接，同时释放定时器和正在发送的文件
+void cb_func (http_conn* user) {
+    user->closeConn();
+}
 
-//处理时间事件
-void deal_timer () {
-    timer_handler();
+//定时器回调和closeConn都在事件循环线程中执行，连接在工作线程中时定时器不能留在时间轮中，否则到期时会关闭工作线程正在使用的连接
+void http_conn::detachTimer () {
+    m_timer_wheel->detach_timer(m_timer);
 }
 
-//回调函数
-void cb_func (int fd) {
-    if (fd != -1) {//这个工作的通信套接字
-        removefd(http_conn::m_epollfd, fd);//从共享的内核事件文件描述符中移除当前通信描述符
-        fd = -1;//将通信套接字设置为-1，表示无通信描述符占用
-        --http_conn::m_user_count;//关闭一个连接当然通信描述符-1
-    }
+//不重新计时，请求头超时从收到第一批数据开始计算，不因为交给工作线程而延长
+void http_conn::attachTimer () {
+    m_timer_wheel->attach_timer(m_timer);
+}
+
+void http_conn::waitRequest () {
+    modfd(m_epollfd, m_sockfd, EPOLLIN, m_generation);
 }
 
 
 //初始化连接，外部调用初始化套接字地址
- void http_conn::initNewConn(int sockfd, const sockaddr_in& addr){//初始化新接入的连接
+ void http_conn::initNewConn(int sockfd, const sockaddr_in& addr, EventLoop* loop){//初始化新接入的连接
     m_sockfd = sockfd;
     m_address = addr;
+    m_epollfd = loop->getEpollfd();//连接固定由这个事件循环负责读写
+    m_loop = loop;
+    next_generation();
+    m_idle = false;//新连接的第一个请求可能已经在路上，排空时不直接关闭，等待它超时或者处理完毕
+    m_timer_wheel = loop->getTimerWheel();
     ++m_user_count;
-    //对这个套接字设置端口复用
-    int opt = 1;
-    int res = setsockopt(sockfd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
-    if (res == -1) {//出错
-        m_sockfd = -1;
-        --m_user_count;
-        //地址也应该清空，但是不知道如何清空
-        // throw std::exception();
-    }
-    adfd(m_epollfd, sockfd, true);//将这个与客户通信的套接字加入内核epollfd中
-
-    //创建定时器，设置回调函数与超时时间，然后绑定定时器与用户数据，最后将定时器插入链表
+    adfd(m_epollfd, sockfd, true, false, m_generation);//将这个与客户通信的套接字加入所属事件循环的epollfd中，套接字已由accept4设置为非阻塞
+
+    //创建定时器，设置回调函数与超时时间，然后绑定定时器与用户数据，最后将定时器插入时间轮
     utill_timer* timer = new utill_timer;
-    time_t cur = time(nullptr);
-    timer->m_expire = cur + 3 * TIMESLOT;
     m_timer = timer;
-    timer->m_user_sockfd = m_sockfd;
+    timer->m_user = this;
     timer->cb_func = cb_func;
-    timer_lst.add_timer(timer);
+    m_timer_wheel->add_timer(timer, IDLE_TIMEOUT);
+    m_read_idx = 0;//标识下一个要读取的位置，读缓冲区在收到数据时才申请
+    m_request_start = 0;
+    m_status = 0;
+    m_stage_time = 0;
     init();//对刚加入的客户进行初始化
  }
 
-//初始化连接
+//初始化请求，读缓冲区中的数据由initNewConn和next_request负责
  void http_conn::init () {
     bytes_have_send = 0;
     bytes_to_send = 0;
@@ -146,18 +215,129 @@ void cb_func (int fd) {
     m_linger = false;//默认不保持连接
 
     m_method = GET;//默认请求方法为请求
-    m_url = 0;//默认请求文件名
-    m_version = 0;//默认HTTP版本协议
+    m_request.clear();//请求行和请求头
     m_content_length = 0;//默认请求消息的长度
-    m_host = 0;//主机名
-    m_start_line = 0;//当前正在解析行的起始位置
-    m_checked_idx = 0;//当前正在分析的字符在读缓冲区的位置
-    m_read_idx = 0;//标识下一个要读取的位置
-    m_write_idx = 0;//表示下一个待发送数据的位置
-    //初始化相关数组
-    bzero(m_read_buf, READ_BUFFER_SIZE);//初始化读取数组
-    bzero(m_write_buf, WRITE_BUFFER_SIZE);//初始化写缓冲的数组
-    bzero(m_real_file, FILENAME_LEN);//初始化请求路径数组
+    m_range_count = 0;
+    m_segment_count = 0;
+    m_segment_idx = 0;
+    m_segment_sent = 0;
+    m_start_line = m_request_start;//当前正在解析行的起始位置
+    m_line_end = m_request_start;
+    m_checked_idx = m_request_start;//当前正在分析的字符在读缓冲区的位置
+    m_write_idx = 0;//表示下一个待发送数据的位置，写缓冲区在填充响应时才申请
+}
+
+/*
+    一个请求响应完毕，准备处理同一连接上的下一个请求
+    客户端可以不等响应就连续发送多个请求（pipelining），readRequest可能已经把后面请求的数据读进了读缓冲区，
+    这里只把下一个请求的起始位置记在m_request_start中，不移动数据；
+    连续处理很多个请求时每次都移动剩余的数据代价是平方级的，等读缓冲区满了再由compact_read_buf一次移走；
+    请求体还没有收完整，或者长度不可信时无法确定下一个请求从哪里开始，返回false，由调用者关闭连接
+*/
+bool http_conn::next_request () {
+    int request_end = m_checked_idx;//请求头之后的位置
+    if (m_check_state == CHECK_STATE_CONTENT) {//还要跳过请求体
+        request_end += m_content_length;
+    }
+    if (request_end < m_checked_idx || request_end > m_read_idx) {
+        return false;
+    }
+    int left = m_read_idx - request_end;
+    if (left == 0) {//没有后续请求，等待下一个请求的长连接不占用读缓冲区
+        m_read_idx = 0;
+        m_request_start = 0;
+        free_read_buf();
+    }
+    else {
+        m_request_start = request_end;
+        m_request_time = now_us();//下一个请求已经在缓冲区中，从现在开始计算它的延迟
+    }
+    free_write_buf();//响应已经发送完毕
+    init();
+    //缓冲区中已经有下一个请求的数据时从现在开始计算请求头超时，否则等待下一个请求
+    if (m_timer != nullptr) {
+        m_timer_wheel->adjust_timer(m_timer, (left > 0) ? HEADER_TIMEOUT : IDLE_TIMEOUT);
+    }
+    return true;
+}
+
+/*
+    读缓冲区已满，换一个大一倍的缓冲区
+    请求行和请求头解析出的指针指向读缓冲区内部，复制以后要按相同的偏移指向新缓冲区
+*/
+bool http_conn::grow_read_buf () {
+    if (m_read_size >= MAX_READ_BUFFER_SIZE) {
+        return false;
+    }
+    int size = m_read_size * 2;
+    if (size > MAX_READ_BUFFER_SIZE) {
+        size = MAX_READ_BUFFER_SIZE;
+    }
+    char* old_buf = m_read_buf;
+    char* new_buf = bufpool.alloc(size, &size);
+    memcpy(new_buf, old_buf, m_read_idx);
+    m_request.rebase(old_buf, new_buf);
+    bufpool.free(old_buf, m_read_size);
+    m_read_buf = new_buf;
+    m_read_size = size;
+    return true;
+}
+
+//写缓冲区放不下，换一个足够大的缓冲区，已经加入m_segments的段按相同的偏移指向新缓冲区
+bool http_conn::grow_write_buf (int need) {
+    if (need > MAX_WRITE_BUFFER_SIZE) {
+        return false;
+    }
+    int size = (m_write_size > 0) ? m_write_size : WRITE_BUFFER_SIZE;
+    while (size < need) {
+        size *= 2;
+    }
+    char* old_buf = m_write_buf;
+    char* new_buf = bufpool.alloc(size, &size);
+    if (old_buf != nullptr) {
+        memcpy(new_buf, old_buf, m_write_idx);
+        for (int i = 0; i < m_segment_count; ++i) {
+            if (m_segments[i].buf != nullptr) {
+                m_segments[i].buf = new_buf + (m_segments[i].buf - old_buf);
+            }
+        }
+        bufpool.free(old_buf, m_write_size);
+    }
+    m_write_buf = new_buf;
+    m_write_size = size;
+    return true;
+}
+
+//当前请求之前的数据都已经处理完，把当前请求移到缓冲区开头，解析位置和m_request中的字段一起前移
+void http_conn::compact_read_buf () {
+    int shift = m_request_start;
+    memmove(m_read_buf, m_read_buf + shift, m_read_idx - shift);
+    m_request.rebase(m_read_buf + shift, m_read_buf);
+    m_read_idx -= shift;
+    m_checked_idx -= shift;
+    m_start_line -= shift;
+    m_line_end = (m_line_end > shift) ? m_line_end - shift : 0;
+    m_request_start = 0;
+}
+
+void http_conn::free_read_buf () {
+    bufpool.free(m_read_buf, m_read_size);
+    m_read_buf = nullptr;
+    m_read_size = 0;
+}
+
+void http_conn::free_write_buf () {
+    bufpool.free(m_write_buf, m_write_size);
+    m_write_buf = nullptr;
+    m_write_size = 0;
+    bufpool.free(m_body, m_body_size);
+    m_body = nullptr;
+    m_body_size = 0;
+}
+
+//上一个响应已经发送完毕，读缓冲区中还有后续请求的数据，需要交给工作线程继续解析
+bool http_conn::hasPendingRequest () {
+    return bytes_to_send == 0 && m_read_idx > m_request_start;
 }
 
 
@@ -174,13 +354,30 @@ void cb_func (int fd) {
 //循环读取客户端数据，直到无数据可读或者对方关闭连接，调用完这个函数，数据已经被读取到read_buf中然后进行解析就行了
  bool http_conn::readRequest () {
     //std::cout << "一次性读取数据" << std::endl;
-    if(m_read_idx >= READ_BUFFER_SIZE) {//读取缓冲区已满，无法继续读取
+    if(m_read_idx - m_request_start >= MAX_READ_BUFFER_SIZE) {//当前请求已经占满了读缓冲区的上限，无法继续读取
         return false;
     }
+    if (m_read_buf == nullptr) {//收到数据时才从内存池申请读缓冲区
+        m_read_buf = bufpool.alloc(READ_BUFFER_SIZE, &m_read_size);
+    }
+    m_idle = false;
+    bool new_request = (m_read_idx == m_request_start);//当前请求还没有数据，这是一个新请求的开始
+    if (new_request) {
+        m_request_time = now_us();
+    }
     int byte_read = 0;
-    while (true) {//循环读取
+    while (true) {
+        //缓冲区满了先移走已经处理完的请求，仍然满就扩大，达到上限时先解析已经读到的请求，剩余数据留在套接字中
+        if (m_read_idx == m_read_size) {
+            if (m_request_start > 0) {
+                compact_read_buf();
+            }
+            else if (!grow_read_buf()) {
+                break;
+            }
+        }
         //从m_read_buf中读取数据
-        byte_read = recv(m_sockfd, m_read_buf + m_read_idx, READ_BUFFER_SIZE - m_read_idx, 0);
+        byte_read = recv(m_sockfd, m_read_buf + m_read_idx, m_read_size - m_read_idx, 0);
         if (byte_read == -1) {//发生错误
             if (errno == EAGAIN || errno == EWOULDBLOCK) {
                 break;//没有数据可读
@@ -194,12 +391,11 @@ void cb_func (int fd) {
     }
     // printf("%s\n", m_read_buf);
     // std:: cout << *m_read_buf << std::endl;
-    //如果客户端上有数据可读，则我们需要调整该连接对应的定时器，以延迟到期
-    if (m_timer != nullptr) {
-        time_t cur = time(nullptr);
-        m_timer->m_expire = cur + 3 * TIMESLOT;
-        std::cout << "adjust timer once：" << m_sockfd << std::endl;
-        timer_lst.adjust_timer(m_timer);
+    //收到新请求的第一批数据时，把空闲定时器换成请求头定时器；
+    //同一个请求后续的数据不再延长，防止客户端每次只发几个字节一直占用连接
+    if (m_timer != nullptr && new_request) {
+        LOG_TRACE("\tAdjust header timer: %d\n", m_sockfd);
+        m_timer_wheel->adjust_timer(m_timer, HEADER_TIMEOUT);
     }
     return true;//读数据成功
  }
@@ -217,25 +413,30 @@ void cb_func (int fd) {
     Upgrade-Insecure-Requests: 1
 */
 //解析一行，判断依据是末尾\r\n
+//行结束符由scan_line_end成批查找，一次比较16或32个字节，不再逐字节判断
+//不在缓冲区中写入字符串结束符，行的范围是[m_start_line, m_line_end)
 http_conn::LINE_STATUS http_conn::parse_line() {//解析行
     char temp;
-    for (; m_checked_idx < m_read_idx; ++m_checked_idx) {
+    if (m_checked_idx < m_read_idx) {
+        m_checked_idx = scan_line_end(m_read_buf + m_checked_idx, m_read_buf + m_read_idx) - m_read_buf;
+    }
+    if (m_checked_idx < m_read_idx) {
         temp = m_read_buf[m_checked_idx];//读缓冲区的一行，根据http协议请求报文看
         if (temp == '\r') {//空格间隔
             if ((m_checked_idx + 1) == m_read_idx) {
                 return LINE_OPEN;//行数据尚且不完整
             }
             else if (m_read_buf[m_checked_idx + 1] == '\n') {
-                m_read_buf[m_checked_idx++] = '\0';//变成字符串结束标志， GET / HTTP/1.1\t\n-> GET / HTTP/1.1\0\0
-                m_read_buf[m_checked_idx++] = '\0';//变成字符串结束标志，这个自增调到下一个要解析的位置
+                m_line_end = m_checked_idx;//行在\r之前结束
+                m_checked_idx += 2;//跳过\r\n，调到下一个要解析的位置
                 return LINE_OK;//行读取完整
             }
             return LINE_BAD;
         }
         else if (temp == '\n') {//向前检查
             if ((m_checked_idx > 1) && (m_read_buf[m_checked_idx - 1] == '\r')) {
-                m_read_buf[m_checked_idx-1] = '\0';//变成字符串结束标志
-                m_read_buf[m_checked_idx++] = '\0';//变成字符串结束标志
+                m_line_end = m_checked_idx - 1;
+                ++m_checked_idx;
                 return LINE_OK;
             }
             else {
@@ -245,53 +446,79 @@ http_conn::LINE_STATUS http_conn::parse_line() {//解析行
     }
     return LINE_OPEN;
 }
+//不区分大小写比较，text不需要以\0结尾
+static bool iequals (std::string_view text, const char* str) {
+    size_t len = strlen(str);
+    return text.size() == len && strncasecmp(text.data(), str, len) == 0;
+}
+
+//去掉首尾的空格和制表符
+static std::string_view trim (std::string_view text) {
+    while (!text.empty() && (text.front() == ' ' || text.front() == '\t')) {
+        text.remove_prefix(1);
+    }
+    while (!text.empty() && (text.back() == ' ' || text.back() == '\t')) {
+        text.remove_suffix(1);
+    }
+    return text;
+}
+
 /***下面一组函数被process_read用来解析HTTP协议**/
-//解析请求行
-http_conn::HTTP_CODE http_conn::parse_request_line (char* text) {//解析请求行
+//解析请求行，各部分保存为指向读缓冲区的string_view，不修改缓冲区
+http_conn::HTTP_CODE http_conn::parse_request_line (std::string_view text) {//解析请求行
     //std::cout << "开始解析HTTP请求，请求行解析中》》》" << std::endl;
     //请求行格式： GET / HTTP/1.1
-    m_url = strpbrk(text, " \t");//查找在text中空格字符,返回查找到的位置
-    if (!m_url) {//未查找到
+    size_t pos = text.find_first_of(" \t");//查找在text中空格字符,返回查找到的位置
+    if (pos == std::string_view::npos) {//未查找到
         return BAD_REQUEST;
     }
-    *m_url++ = '\0';//将空格设置为字符结束符GET\0/ HTTP/1.1,并将m_url指向下一个位置
-    char* methond = text;//此时text是：GET\0/ HTTP/1.1,而指针指向的这是GET
-    if (strcasecmp(methond, "GET") == 0) {//比较是否相等
+    m_request.method = text.substr(0, pos);//空格之前是请求方法
+    if (iequals(m_request.method, "GET")) {//比较是否相等
         m_method = GET;//客户端的请求是GET;
     }
     else {//这里只支持GET方法
         return BAD_REQUEST;
     }
-    //继续解析后面的数据
-    //此时m_url的指向是指在/ HTTP/1.1，重复找到空格，设置\0,获取字符串
-    m_version = strpbrk(m_url, " \t");//找到空格
-    if (!m_version) {//未找到空格
+    //继续解析后面的数据，此时text剩下/ HTTP/1.1
+    text.remove_prefix(pos + 1);
+    pos = text.find_first_of(" \t");//找到空格
+    if (pos == std::string_view::npos) {//未找到空格
         return BAD_REQUEST;
     }
-    *m_version++ = '\0';//将空格设置为字符结束符/\0HTTP/1.1,并将m_url指向下一个位置
-    if (strcasecmp(m_version, "HTTP/1.1") != 0) {//是否是HTTP1.1
+    std::string_view target = text.substr(0, pos);
+    m_request.version = text.substr(pos + 1);
+    if (!iequals(m_request.version, "HTTP/1.1")) {//是否是HTTP1.1
         return BAD_REQUEST;
     }
+    m_linger = true;//HTTP/1.1默认保持连接，除非客户端发送Connection: close
     //解析url
     /**
      * http://192.168.110.129:10000/index.html
     */
-    if (strncasecmp(m_url, "http://", 7) == 0) {//比较m_url前7个是否是这个
-        m_url += 7;//移动到真正的ip地址处
-        //在参数str所指向的字符串中搜索第一次出现字符c（一个无符号字符）的位置
-        m_url = strchr(m_url, '/');
-        //std:: cout << m_url << std::endl;
+    if (target.size() >= 7 && strncasecmp(target.data(), "http://", 7) == 0) {//比较前7个是否是这个
+        target.remove_prefix(7);//移动到真正的ip地址处
+        pos = target.find('/');//跳过主机和端口
+        if (pos == std::string_view::npos) {
+            return BAD_REQUEST;
+        }
+        target.remove_prefix(pos);
     }
-    if (!m_url || m_url[0] != '/') {
+    if (target.empty() || target[0] != '/') {
         return BAD_REQUEST;
     }
+    m_request.target = target;
+    pos = target.find('?');//问号之后是查询参数，查找文件时不使用
+    m_request.path = target.substr(0, pos);
+    if (pos != std::string_view::npos) {
+        m_request.query = target.substr(pos + 1);
+    }
     m_check_state = CHECK_STATE_HEADER;//开始检查请求头
     return NO_REQUEST;//请求不完整
 }
 //解析请求头
-http_conn::HTTP_CODE http_conn::parse_headers (char* text) {//解析请求头
+http_conn::HTTP_CODE http_conn::parse_headers (std::string_view text) {//解析请求头
     //遇到空行，表示请求头解析完毕
-    if (text[0] == '\0') {
+    if (text.empty()) {
         //如果HTTP请求有消息体，则还需要读取m_content_length字节的消息体
         //状态转移到CHECK_STATE_CONTENT状态
         if (m_content_length != 0) {//有请求体需要进行解析
@@ -301,39 +528,58 @@ http_conn::HTTP_CODE http_conn::parse_headers (char* text) {//解析请求头
         //否则说明，没有请求体，我们已经得到了一个完整的HTTP请求
         return GET_REQUEST;
     }
-    else if (strncasecmp(text, "Connection:", 11) == 0) {//判断连接情况
-    /*
-        Connection: keep-alive
-    */
-        //处理Connection头部字段，
-        text += 11;//移动指针位置
-        text += strspn(text, " \t");// 检索字符串 str1 中第一个不在字符串 str2 中出现的字符下标
-        if (strcasecmp(text, "keep-alive") == 0) {//判断是否是 保持连接
-            m_linger = true;
-        }
-    }
-    else if (strncasecmp(text, "Content-Length:", 15) == 0) {//解析请求体长度
-        //处理Content-Length头部字段
-        text += 15;
-        text += strspn(text, " \t");
-        m_content_length = atol(text);//转换为整数
-    }
-    else if (strncasecmp(text, "Host:", 5) == 0) {//获取Host头部字段,主机域名
-        //处理Host头部字段
-        text += 5;
-        text += strspn(text, " \t");
-        m_host = text;//主机域名
-        // std:: cout << m_host << std::endl;
+
+    //冒号之前是请求头名称，用完美哈希查出是哪一个，浏览器发来的大部分请求头都是不关心的，一次查表就能跳过
+    size_t colon = text.find(':');
+    if (colon == std::string_view::npos) {
+        return NO_REQUEST;//不是请求头，忽略
     }
-    else {
-       // std::cout << "oop! unkonw header" << text << std::endl;
+    std::string_view name = text.substr(0, colon);
+    std::string_view value = trim(text.substr(colon + 1));
+    int header = lookup_header(name.data(), name.size());
+    m_request.add_header(header, value);//Host、Range、If-Range等请求头直接从m_request中取
+    switch (header) {
+        case HEADER_CONNECTION : {//判断连接情况
+        /*
+            Connection: keep-alive
+        */
+            if (iequals(value, "keep-alive")) {//判断是否是 保持连接
+                m_linger = true;
+            }
+            else if (iequals(value, "close")) {//响应完毕后关闭连接
+                m_linger = false;
+            }
+            break;
+        }
+        case HEADER_CONTENT_LENGTH : {//解析请求体长度
+            //请求体要整个放进读缓冲区，超过上限、为空或者含有非数字字符时拒绝，逐位检查上限，不会溢出
+            if (value.empty()) {
+                return BAD_REQUEST;
+            }
+            uint64_t length = 0;
+            for (size_t i = 0; i < value.size(); ++i) {//转换为整数
+                if (!isdigit((unsigned char)value[i])) {
+                    return BAD_REQUEST;
+                }
+                length = length * 10 + (value[i] - '0');
+                if (length > MAX_READ_BUFFER_SIZE) {
+                    return BAD_REQUEST;
+                }
+            }
+            m_content_length = (int)length;
+            break;
+        }
+        default : {
+           // std::cout << "oop! unkonw header" << text << std::endl;
+            break;
+        }
     }
     return NO_REQUEST;//请求不完整，继续解析请求头
 }
 //解析请求体，在请求报文中一般不用这个字段，在响应报文中也可能没有这个字段
-http_conn::HTTP_CODE http_conn::parse_content (char* text) {//解析请求体
+http_conn::HTTP_CODE http_conn::parse_content () {//解析请求体
     if (m_read_idx >= (m_content_length + m_checked_idx)) {
-        text[m_content_length] = '\0';
+        //请求体之后可能是下一个请求的数据，不能再写入字符串结束符
         return GET_REQUEST;//获取完整请求
     }
     return NO_REQUEST;//请求不完整，继续解析请求
@@ -341,21 +587,39 @@ http_conn::HTTP_CODE http_conn::parse_content (char* text) {//解析请求体
 //解析完HTTP请求报文以后，做出响应
 /*
     当得到一个完整、正确的HTTP请求时，我们就分析目标文件的属性
-    如果目标文件存在，对所有用户可读，并且不是目录，则使用mmap将其映射到内存
-    地址为m_file_address处，并告诉调用者获取文件成功
+    目标文件从进程共享的文件缓存中获取，热门文件命中缓存时不需要任何文件系统调用，
+    如果目标文件存在，对所有用户可读，并且不是目录，则保存在m_file中，
+    发送时用sendfile从页缓存直接拷贝到套接字，不再mmap到用户态，并告诉调用者获取文件成功
 */
 http_conn::HTTP_CODE http_conn::do_request () {
     //"/home/wenp/vscode/buildwebsever/resources"
-    strcpy(m_real_file, doc_root);//拷贝到m_real_file
+    //完整路径只在查找文件时使用，从内存池中临时申请，长度不再受限
     int len = strlen(doc_root);//获取长度
-    //strncpy(m_real_file + len, m_url, FILENAME_LEN - len -1);
-    strcpy(m_real_file + len, m_url);//形成请求的完整路径：/home/wenp/vscode/buildwebsever/resources/index.html
+    std::string_view path = m_request.path;
+    if (path == METRICS_PATH && metrics.enabled()) {//运行统计不对应文件
+        return METRICS_REQUEST;
+    }
+    int real_file_size = 0;
+    char* real_file = bufpool.alloc(len + path.size() + 1, &real_file_size);
+    memcpy(real_file, doc_root, len);//拷贝到real_file
+    memcpy(real_file + len, path.data(), path.size());//形成请求的完整路径：/home/wenp/vscode/buildwebsever/resources/index.html
+    real_file[len + path.size()] = '\0';
 
-    // printf("%s\n", m_real_file);
-    //获取m_real_file文件的相关的状态信息，-1失败，0成功
-    if (stat(m_real_file, &m_file_stat) < 0) {//函数stat()通过文件名filename获取文件信息，并保存在buf所指的结构体stat中
-        return NO_REQUEST;//请求不完整
+    // printf("%s\n", real_file);
+    //从文件缓存中获取real_file文件及其状态信息，未命中时由缓存调用stat和open
+    int err = 0;
+    m_file = filecache.acquire(real_file, &err);
+    bufpool.free(real_file, real_file_size);
+    if (m_file == nullptr) {
+        if (err == EACCES) {
+            return FORBIDDEN_REQUEST;
+        }
+        if (err == EISDIR) {//目录不缓存，与下面的目录判断一样回复400
+            return BAD_REQUEST;
+        }
+        return NO_RESOURCE;//文件不存在
     }
+    m_file_stat = m_file->st;
 
     /*
         st_mode 宏定义中文件状态有如下这些：（部分）
@@ -375,72 +639,124 @@ http_conn::HTTP_CODE http_conn::do_request () {
 
     //判断访问权限
     if (!(m_file_stat.st_mode & S_IROTH)) {//用户是否具有可读权限
+        closeFile();
         return FORBIDDEN_REQUEST;//禁止访问
     }
 
     //判断是否为目录
     if (S_ISDIR(m_file_stat.st_mode)) {
+        closeFile();
         return BAD_REQUEST;//访问错误
     }
 
-    //以只读方式打开
-    int fd = open(m_real_file, O_RDONLY);
-    //创建内存映射
-    m_file_address = (char*)mmap(nullptr, m_file_stat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
-    close(fd);
+    //有Range头部并且文件没有改变时只发送请求的范围
+    if (m_request.get(HEADER_RANGE).data() != nullptr && if_range_match()) {
+        int count = parse_range();
+        if (count < 0) {
+            closeFile();//416响应只需要文件大小，已经保存在m_file_stat中
+            return RANGE_NOT_SATISFIABLE;
+        }
+        m_range_count = count;
+    }
+
+    //文件在响应发送完毕后释放
     return FILE_REQUEST;
 }
+
+//根据文件大小解析Range头部，返回范围个数，0表示发送整个文件，-1表示范围无法满足
+int http_conn::parse_range () {
+    return parse_byte_ranges(m_request.get(HEADER_RANGE), m_file_stat.st_size, m_ranges, MAX_RANGES);
+}
+
+//If-Range的值可以是ETag或者Last-Modified，与当前文件一致时才按Range发送
+bool http_conn::if_range_match () {
+    std::string_view if_range = m_request.get(HEADER_IF_RANGE);
+    if (if_range.data() == nullptr) {
+        return true;
+    }
+    if (!if_range.empty() && if_range[0] == '"') {//强ETag，弱ETag以W/开头，不能用于If-Range
+        return if_range == m_file->etag;
+    }
+    return if_range == m_file->last_modified;
+}
 //下面这一组函数被process_write用来调用以填充HTTP应答
-void http_conn::unmap () {//对内存映射区执行munmap操作
-    if (m_file_address) {
-        munmap(m_file_address, m_file_stat.st_size);
-        m_file_address = 0;
+void http_conn::closeFile () {//释放请求的目标文件，缓存中的文件只减少引用计数，不会关闭
+    if (m_file != nullptr) {
+        filecache.release(m_file);
+        m_file = nullptr;
     }
 }
 //写HTTP响应
+//响应由m_segments中的若干段组成：写缓冲区中的段（响应头、multipart分隔头）用send发送；
+//文件段用sendfile发送，避免mmap带来的页表开销和用户态拷贝
 bool http_conn::writetoClient () {
     int temp = 0;
     if (bytes_to_send == 0) {
         //将要发送的字节树为0，这一次响应结束
-        modfd(m_epollfd, m_sockfd, EPOLLIN);//改变文件描述符
-        init();
+        log_access();
+        if (!next_request()) {
+            return false;
+        }
+        if (!hasPendingRequest()) {
+            m_idle = true;
+            modfd(m_epollfd, m_sockfd, EPOLLIN, m_generation);//改变文件描述符
+        }
         return true;
     }
 
     while (true) {//一直循环写，向客户端发送数据
-        //分散写
-        temp = writev(m_sockfd, m_iv, m_iv_count);
+        send_segment* seg = &m_segments[m_segment_idx];
+        int seg_left = seg->len - m_segment_sent;
+        if (seg->buf != nullptr) {//写缓冲区中的段
+            //后面还有数据时带上MSG_MORE，让内核把响应头和文件开头合并成完整的报文再发出
+            int flags = (bytes_to_send > seg_left) ? MSG_MORE : 0;
+            temp = send(m_sockfd, seg->buf + m_segment_sent, seg_left, flags);
+        }
+        else {//文件段，已发送的字节数保存在m_segment_sent中，跨多轮EPOLLOUT继续发送
+            off_t offset = seg->offset + m_segment_sent;
+            temp = sendfile(m_sockfd, m_file->fd, &offset, seg_left);
+            if (temp == 0) {//文件在发送过程中被截断，无法再发送剩余的内容
+                closeFile();
+                return false;
+            }
+        }
         if (temp <= -1) {
             //如果TCP写缓冲没有空间，则等待下一轮EPOLLOUT事件，虽然在此期间
             //服务器无法立即接收到同一客户的下一个请求，但可以保证连接的完整性
             if (errno == EAGAIN) {
-                modfd(m_epollfd, m_sockfd, EPOLLOUT);
+                modfd(m_epollfd, m_sockfd, EPOLLOUT, m_generation);
                 return true;
             }
-            unmap();//写事件失败后，释放内存映射
+            closeFile();//写事件失败后，释放文件
             return false;
         }
         bytes_have_send += temp;
         bytes_to_send -= temp;
-        
-        if (m_iv[0].iov_len <= bytes_have_send) {//已经发送完HTTP响应报文
-            //发送HTTP响应成功，根据HTTP请求中的Connection字段决定是否立即关闭连接
-            m_iv[0].iov_len = 0;
-            m_iv[1].iov_base = m_file_address + (bytes_have_send - m_write_idx);
-            m_iv[1].iov_len = bytes_to_send;
+        m_segment_sent += temp;
+        if (m_timer != nullptr) {//发送有进展，大文件发送时间再长也不算超时
+            m_timer_wheel->adjust_timer(m_timer, IDLE_TIMEOUT);
         }
-        else {
-            m_iv[0].iov_base = m_write_buf + bytes_have_send;
-            m_iv[0].iov_len = m_iv[0].iov_len - temp;
+        if (m_segment_sent == seg->len) {//当前段发送完毕，开始发送下一段
+            ++m_segment_idx;
+            m_segment_sent = 0;
         }
 
         if (bytes_to_send <= 0) {
             //没有数据要发送了
-            unmap();//释放内存映射
-            modfd(m_epollfd, m_sockfd, EPOLLIN);//将文件描述符修改为读取状态
+            log_access();//next_request之前记录，请求的路径还在读缓冲区中
+            closeFile();//释放文件
 
-            if (m_linger) {//是否保持连接，是
-                init();//重新初始化，准备下一次请求
+            //发送HTTP响应成功，根据HTTP请求中的Connection字段决定是否立即关闭连接，排空时一律关闭
+            if (m_linger && !m_loop->isDraining()) {//是否保持连接，是
+                if (!next_request()) {//重新初始化，保留已经读到的后续请求
+                    return false;
+                }
+                //缓冲区中还有后续请求时由事件循环交给工作线程，工作线程处理完再注册事件，
+                //这里不能注册EPOLLIN，否则可能出现两个线程同时操作这个连接
+                if (!hasPendingRequest()) {
+                    m_idle = true;
+                    modfd(m_epollfd, m_sockfd, EPOLLIN, m_generation);//将文件描述符修改为读取状态
+                }
                 return true;
             }
             else {
@@ -450,86 +766,167 @@ bool http_conn::writetoClient () {
     }
 }
 
-//向写缓冲区中写入待发送的数据
-bool http_conn::add_response(const char* format, ...) {
-    if (m_write_idx >= WRITE_BUFFER_SIZE) {//写缓冲区以满
-        return false;
-    }
-
-    va_list arg_list;//获取可变参数列表
-    va_start(arg_list, format);//第一个参数是可变参数列表变量，第二个是可变参数前的最后一个确定变量参数，用来推算出可变参数的位置
-    int len = vsnprintf( m_write_buf + m_write_idx, WRITE_BUFFER_SIZE - 1 - m_write_idx, format, arg_list );
-    if( len >= ( WRITE_BUFFER_SIZE - 1 - m_write_idx ) ) {//len最终成功写入的返回值数
+//向写缓冲区中追加数据
+//写缓冲区放不下时扩大，超过MAX_WRITE_BUFFER_SIZE时失败
+bool http_conn::add_text(const char* text, int len) {
+    if (m_write_idx + len > m_write_size && !grow_write_buf(m_write_idx + len)) {//第一次写入时才申请写缓冲区
         return false;
     }
-    m_write_idx += len;//移动下一次需要开始写入的位置
-    va_end( arg_list );//结束可变参数列表的写入过程
-
+    memcpy(m_write_buf + m_write_idx, text, len);
+    m_write_idx += len;
     return true;
 }
 
-bool http_conn::add_content(const char* content) {
-    return add_response( "%s", content );
+bool http_conn::add_number(unsigned long long value) {
+    char buf[MAX_DECIMAL_LEN];
+    return add_text(buf, format_decimal(buf, value));
 }
 
+//文件的类型在文件缓存打开文件时已经按扩展名确定，见mimetype.h
 bool http_conn::add_content_type() {
-    /*
-    常见的媒体格式类型如下：
-    text/html ： HTML格式
-    text/plain ：纯文本格式      
-    text/xml ：  XML格式
-    image/gif ：gif图片格式    
-    image/jpeg ：jpg图片格式 
-    image/png：png图片格式
-    以application开头的媒体格式类型：
-
-    application/xhtml+xml ：XHTML格式
-    application/xml     ： XML数据格式
-    application/atom+xml  ：Atom XML聚合格式    
-    application/json    ： JSON数据格式
-    application/pdf       ：pdf格式  
-    application/msword  ： Word文档格式
-    application/octet-stream ： 二进制流数据（如常见的文件下载）
-    */
-    char* getTypeFile = strchr(m_url, '.');//找到位置
-    ++getTypeFile;//移动到文件名真正开始的位置
-    if (strcasecmp(getTypeFile, "pdf") == 0) {
-        return add_response("Content-Type: %s\r\n", "application/pdf");
-    }
-    else if (strcasecmp(getTypeFile, "zip") == 0) {
-        return add_response("Content-Type: %s\r\n", "application/octet-stream");
-    }
-    return add_response("Content-Type: %s\r\n", "text/html");
+    return add_text(m_file->content_type);
 }
 
-bool http_conn::add_status_line(int status, const char* title) {
-    return add_response( "%s %d %s\r\n", "HTTP/1.1", status, title );
+bool http_conn::add_status_line(std::string_view line) {
+    return add_text(line);
 }
 
-bool http_conn::add_headers(int content_length) {
-    add_content_length(content_length);
-    add_content_type();
-    add_linger();
-    add_blank_line();
+bool http_conn::add_content_length(off_t content_length) {
+    return add_text("Content-Length: ") && add_number(content_length) && add_text("\r\n");
 }
 
-bool http_conn::add_content_length(int content_length) {
-    return add_response( "Content-Length: %d\r\n", content_length);
+bool http_conn::add_linger() {
+    return add_text(m_linger ? "Connection: keep-alive\r\n" : "Connection: close\r\n");
 }
 
-bool http_conn::add_linger() {
-    return add_response( "Connection: %s\r\n", ( m_linger == true ) ? "keep-alive" : "close" );
+bool http_conn::add_date() {
+    return add_text(http_date_header());
 }
 
 bool http_conn::add_blank_line() {
-    return add_response( "%s", "\r\n" );
+    return add_text("\r\n");
+}
+
+bool http_conn::add_content_range(off_t start, off_t end) {
+    return add_text("Content-Range: bytes ") && add_number(start) && add_text("-") && add_number(end)
+        && add_text("/") && add_number(m_file_stat.st_size) && add_text("\r\n");
+}
+
+//告诉客户端支持Range请求，并给出If-Range可以使用的ETag和Last-Modified，打开文件时已经生成
+bool http_conn::add_file_validators() {
+    return add_text(m_file->validators);
+}
+
+void http_conn::add_segment(const char* buf, off_t offset, int len) {
+    if (len <= 0) {//空文件或者空段不需要发送
+        return;
+    }
+    m_segments[m_segment_count].buf = buf;
+    m_segments[m_segment_count].offset = offset;
+    m_segments[m_segment_count].len = len;
+    ++m_segment_count;
+    bytes_to_send += len;
+}
+
+/*
+    填充文件请求的响应，分为三种情况：
+    1.没有Range：200，发送整个文件
+    2.一个范围：206，Content-Range给出范围，只发送这一段
+    3.多个范围：206，Content-Type为multipart/byteranges，每个范围前面有分隔符和自己的Content-Type、Content-Range
+    多个范围时先把每个范围的分隔头写入写缓冲区，算出消息体总长度后再写响应头，
+    写缓冲区中各部分的先后顺序与发送顺序无关，发送顺序由m_segments决定
+*/
+bool http_conn::add_file_response() {
+    m_status = (m_range_count == 0) ? 200 : 206;
+    if (m_range_count == 0) {
+        int header_start = m_write_idx;
+        if (!(add_status_line(status_200_line) && add_content_length(m_file_stat.st_size)
+              && add_content_type() && add_file_validators() && add_date() && add_linger() && add_blank_line())) {
+            return false;
+        }
+        add_segment(m_write_buf + header_start, 0, m_write_idx - header_start);
+        add_segment(nullptr, 0, m_file_stat.st_size);
+        return true;
+    }
+
+    if (m_range_count == 1) {
+        off_t start = m_ranges[0].start;
+        off_t end = m_ranges[0].end;
+        int header_start = m_write_idx;
+        if (!(add_status_line(status_206_line) && add_content_length(end - start + 1)
+              && add_content_type() && add_content_range(start, end) && add_file_validators()
+              && add_date() && add_linger() && add_blank_line())) {
+            return false;
+        }
+        add_segment(m_write_buf + header_start, 0, m_write_idx - header_start);
+        add_segment(nullptr, start, end - start + 1);
+        return true;
+    }
+
+    //每个范围的分隔头
+    int part_start[MAX_RANGES];
+    int part_len[MAX_RANGES];
+    int content_length = 0;
+    for (int i = 0; i < m_range_count; ++i) {
+        part_start[i] = m_write_idx;
+        if (!(add_text(byteranges_part) && add_content_type()
+              && add_content_range(m_ranges[i].start, m_ranges[i].end) && add_blank_line())) {
+            return false;
+        }
+        part_len[i] = m_write_idx - part_start[i];
+        content_length += part_len[i] + (m_ranges[i].end - m_ranges[i].start + 1);
+    }
+    //结束分隔符
+    int tail_start = m_write_idx;
+    if (!add_text(byteranges_tail)) {
+        return false;
+    }
+    int tail_len = m_write_idx - tail_start;
+    content_length += tail_len;
+
+    int header_start = m_write_idx;
+    if (!(add_status_line(status_206_line) && add_content_length(content_length) && add_text(byteranges_type)
+          && add_file_validators() && add_date() && add_linger() && add_blank_line())) {
+        return false;
+    }
+    add_segment(m_write_buf + header_start, 0, m_write_idx - header_start);
+    for (int i = 0; i < m_range_count; ++i) {
+        add_segment(m_write_buf + part_start[i], 0, part_len[i]);
+        add_segment(nullptr, m_ranges[i].start, m_ranges[i].end - m_ranges[i].start + 1);
+    }
+    add_segment(m_write_buf + tail_start, 0, tail_len);
+    return true;
 }
 
-//主状态机：解析HTTP请求
+/*
+    填充运行统计的响应，统计文本可能超过写缓冲区的上限，单独放在从内存池申请的m_body中；
+    响应头写完以后才加入段，之后不再向写缓冲区追加，写缓冲区扩大时不会移动m_body所在的段
+*/
+bool http_conn::add_metrics_response() {
+    m_status = 200;
+    std::string text;
+    metrics.render(text);
+    m_body = bufpool.alloc(text.size(), &m_body_size);
+    memcpy(m_body, text.data(), text.size());
+    if (!(add_status_line(status_200_line) && add_content_length(text.size()) && add_text(metrics_type)
+          && add_text("Cache-Control: no-store\r\n") && add_date() && add_linger() && add_blank_line())) {
+        return false;
+    }
+    add_segment(m_write_buf, 0, m_write_idx);
+    add_segment(m_body, 0, text.size());
+    return true;
+}
+
+/*
+    主状态机：解析HTTP请求
+    解析是可以中断和继续的：主状态机的状态、当前行的起始位置和已经检查到的位置都保存在连接中，
+    请求不完整时返回NO_REQUEST，读到更多数据后从上次停下的位置继续，已经检查过的字节不会再扫描；
+    一行被拆到两个TCP报文中时，parse_line停在行尾返回LINE_OPEN，下次从那里继续查找行结束符
+*/
 http_conn::HTTP_CODE http_conn::process_read () {
     LINE_STATUS line_status = LINE_OK;
     HTTP_CODE ret = NO_REQUEST;
-    char* text = 0;
+    std::string_view text;
     //std::cout << "开始解析HTTP请求，主状态机解析中》》》" << std::endl;
     //在解析请求体，并且行的状态也ok
     while (((m_check_state == CHECK_STATE_CONTENT) && (line_status == LINE_OK))
@@ -558,91 +955,158 @@ http_conn::HTTP_CODE http_conn::process_read () {
                 break;
             }
             case CHECK_STATE_CONTENT : {//解析请求体
-                ret = parse_content(text);
+                ret = parse_content();
                 if (ret == GET_REQUEST) {//获得了一个完整的请求
                     return do_request();
                 }
-                break;
+                //请求体还没有收完，等待更多数据；不能再调用parse_line，否则会把请求体当成请求头扫描，移动m_checked_idx
+                return NO_REQUEST;
             }
             default : {
                 return INTERNAL_ERROR;//错误
             }
         }
     }
+    if (line_status == LINE_BAD) {//行结束符不是\r\n
+        return BAD_REQUEST;
+    }
+    //读缓冲区已经达到上限，请求头还没有结束，再读也放不下
+    if (m_check_state != CHECK_STATE_CONTENT && m_read_idx - m_request_start >= MAX_READ_BUFFER_SIZE) {
+        return HEADER_TOO_LARGE;
+    }
     return NO_REQUEST;
 }
 
 //填充HTTP应答
+//错误响应由预先生成的部分和少量追加的头部组成，整个响应在写缓冲区中，作为一段发送
 bool http_conn::process_write (HTTP_CODE ret) {
+    const error_response* resp = nullptr;
     switch (ret) {
         case INTERNAL_ERROR : {
-            add_status_line(500, error_500_title);
-            add_headers(strlen(error_500_form));
-            if (!add_content(error_500_form)) {
-                return false;
-            }
+            m_linger = false;
+            resp = &error_500;
+            m_status = 500;
             break;
         }
         case BAD_REQUEST : {
-            add_status_line(400, error_400_title);
-            add_headers(strlen(error_400_form));
-            if (!add_content(error_400_form)) {
-                return false;
-            }
+            m_linger = false;//无法确定下一个请求从哪里开始，响应后关闭连接
+            resp = &error_400;
+            m_status = 400;
             break;
         }
-        case NO_REQUEST : {
-            add_status_line(404, error_400_title);
-            add_headers(strlen(error_404_form));
-            if (!add_content(error_404_form)) {
-                return false;
-            }
+        case NO_RESOURCE : {
+            resp = &error_404;
+            m_status = 404;
+            break;
         }
         case FORBIDDEN_REQUEST : {
-            add_status_line(403, error_403_title);
-            add_headers(strlen(error_403_form));
-            if (!add_content(error_403_form)) {
-                return false;
-            }
+            resp = &error_403;
+            m_status = 403;
+            break;
+        }
+        case HEADER_TOO_LARGE : {
+            m_linger = false;//剩余的请求头还在套接字中，无法继续解析
+            resp = &error_431;
+            m_status = 431;
+            break;
+        }
+        case RANGE_NOT_SATISFIABLE : {
+            resp = &error_416;
+            m_status = 416;
+            break;
+        }
+        case SERVICE_UNAVAILABLE : {
+            m_linger = false;//请求还没有解析，不知道下一个请求从哪里开始
+            resp = &error_503;
+            m_status = 503;
+            break;
         }
         case FILE_REQUEST : {
-            add_status_line(200, ok_200_title);
-            add_headers(m_file_stat.st_size);
-            m_iv[0].iov_base = m_write_buf;
-            m_iv[0].iov_len = m_write_idx;
-            m_iv[1].iov_base = m_file_address;
-            m_iv[1].iov_len = m_file_stat.st_size;
-            m_iv_count = 2;
-            bytes_to_send = m_write_idx + m_file_stat.st_size;
-            return true;
+            //响应头在m_write_buf中，文件内容由sendfile发送
+            return add_file_response();
+        }
+        case METRICS_REQUEST : {
+            return add_metrics_response();
         }
         default:
             return false;
     }
-    m_iv[0].iov_base = m_write_buf;
-    m_iv[0].iov_len = m_write_idx;
-    m_iv_count = 1;
-    bytes_to_send = m_write_idx;
+
+    if (!add_text(resp->head)) {
+        return false;
+    }
+    if (ret == RANGE_NOT_SATISFIABLE) {
+        if (!(add_text("Content-Range: bytes */") && add_number(m_file_stat.st_size) && add_text("\r\n"))) {
+            return false;
+        }
+    }
+    else if (ret == SERVICE_UNAVAILABLE) {
+        if (!(add_text("Retry-After: ") && add_number(RETRY_AFTER_MIN + m_sockfd % RETRY_AFTER_SPREAD) && add_text("\r\n"))) {
+            return false;
+        }
+    }
+    if (!(add_date() && add_linger() && add_blank_line() && add_text(resp->body))) {
+        return false;
+    }
+    add_segment(m_write_buf, 0, m_write_idx);//错误响应只有写缓冲区中的一段
     return true;
+}
 
+//响应结束时调用，连接中途关闭时由closeConn调用，m_status为0表示已经记录过或者没有响应
+void http_conn::log_access () {
+    if (m_status == 0) {
+        return;
+    }
+    uint64_t now = metrics.clock();
+    if (now != 0) {
+        metrics.observe(HIST_WRITE, m_stage_time, now);
+        metrics.observe(HIST_REQUEST, m_request_time * 1000, now);
+        metrics.responded(m_status, bytes_have_send);
+    }
+    if (accesslog.isOpen()) {
+        //请求行解析成功以后才知道请求方法和路径
+        bool parsed = m_check_state != CHEACK_STATE_REQUESTLINE;
+        accesslog.write(m_address, parsed ? m_method : ACCESS_METHOD_UNKNOWN, parsed ? m_request.path : std::string_view(),
+                        m_status, bytes_have_send, now_us() - m_request_time);
+    }
+    m_status = 0;
+}
+
+/*
+    线程池的请求队列已满时在事件循环中调用，不解析请求，直接回复503并关闭连接，
+    连接此时没有注册任何事件，也没有工作线程在处理，所以可以在事件循环线程中直接发送；
+    一次发送不完时由writetoClient注册EPOLLOUT继续发送
+*/
+bool http_conn::rejectRequest () {
+    process_write(SERVICE_UNAVAILABLE);
+    m_stage_time = metrics.clock();
+    return writetoClient();
 }
 
 /************在工作线程中调用次函数*********************/
  void http_conn::process () {//工作线程需要执行的任务
     //解析客户端的HTTP请求
     // std::cout << "解析客户端的HTTP请求" << std::endl;
+    uint64_t start = metrics.clock();
+    metrics.observe(HIST_QUEUE, m_stage_time, start);
     HTTP_CODE read_ret = process_read();
+    uint64_t parsed = metrics.clock();
+    metrics.observe(HIST_PARSE, start, parsed);
+    //处理完毕后把连接交还给所属的事件循环，由它放回定时器并注册事件或者关闭连接，交还以后不能再访问这个对象
     if (read_ret == NO_REQUEST) {//没有请求
-        modfd(m_epollfd, m_sockfd, EPOLLIN);// 修改socket状态，可再触发
+        m_loop->returnConn(this, RETURN_READ);//请求还没有收完整，继续读取
         return;
     }
 
+    if (m_loop->isDraining()) {//服务器正在退出，告诉客户端这是连接上的最后一个响应
+        m_linger = false;
+    }
     //回复客户端的HTTP的请求
     bool write_ret = process_write(read_ret);
-    if (!write_ret) {//写出失败，关闭连接
-        closeConn();
-    }
-    modfd(m_epollfd, m_sockfd, EPOLLOUT);//修改文件描述符有写事件已经准备好啦
+    m_stage_time = metrics.clock();//从这里开始计算发送的耗时
+    metrics.observe(HIST_BUILD, parsed, m_stage_time);
+    //写出失败时也由事件循环关闭连接，时间轮和连接的关闭只在事件循环线程中操作
+    m_loop->returnConn(this, write_ret ? RETURN_WRITE : RETURN_CLOSE);
 
  }
 
@@ -11,20 +11,34 @@
 #include <fcntl.h>
 #include <string.h>
 #include <sys/stat.h>
-#include <sys/mman.h>
-#include <sys/uio.h>
-#include <stdarg.h>
+#include <sys/sendfile.h>
+#include <atomic>
 #include "threadpool.h"
 #include "locker.h"
 #include "sem.h"
 #include "cond.h"
 #include "utill_timer.h"
+#include "filecache.h"
+#include "http_request.h"
+#include "httprange.h"
+
+#define IDLE_TIMEOUT 15000 // 连接空闲（等待下一个请求或者发送没有进展）的超时时间，单位毫秒
+#define HEADER_TIMEOUT 10000 // 从收到请求的第一个字节起，必须在这个时间内收完整个请求，单位毫秒
+#define RETRY_AFTER_MIN 1 // 过载时503响应中Retry-After的最小秒数
+#define RETRY_AFTER_SPREAD 4 // Retry-After按连接在最小值之上再错开0到这个值减1秒，避免被拒绝的客户端同时重试
+
+class EventLoop;
+class timer_wheel;
        
 class http_conn {
 public:
-    static const int FILENAME_LEN = 200;//文件名的最大长度
-    static const int READ_BUFFER_SIZE = 2048;//读缓冲区的大小
-    static const int WRITE_BUFFER_SIZE = 2048;//写缓冲区的大小
+    //读写缓冲区从内存池中申请，按需翻倍扩大，连接空闲时归还
+    static const int READ_BUFFER_SIZE = 2048;//读缓冲区的初始大小
+    static const int MAX_READ_BUFFER_SIZE = 65536;//读缓冲区的上限，请求头超过这个大小时关闭连接
+    static const int WRITE_BUFFER_SIZE = 1024;//写缓冲区的初始大小
+    static const int MAX_WRITE_BUFFER_SIZE = 16384;//写缓冲区的上限
+    static const int MAX_RANGES = 8;//一个Range请求中最多支持的范围个数，超过时忽略Range返回整个文件
+    static const int MAX_SEGMENTS = 2 * MAX_RANGES + 2;//一个响应最多由多少段组成
 
     /*******HTTP请求方法**********/
     //定义成枚举类型，这里支持GET,自己补充实现POST请求
@@ -48,12 +62,17 @@ public:
         BAD_REQUEST : 表示客户请求语法错误
         NO_RESOURCE : 表示没有服务器资源
         FORBIDDEN_REQUEST : 表示客户对资源没有足够的访问权限
-        FILE_REQUEST : 文件请求，获取文件成功
+        FILE_REQUEST : 文件请求，获取文件成功，m_range_count不为0时只发送请求的范围
         INTERNAL_ERROR : 表示服务器内部错误
         CLOSED_CONNECTION : 表示客户端已经关闭连接了
+        RANGE_NOT_SATISFIABLE : 表示请求的范围都超出了文件大小
+        SERVICE_UNAVAILABLE : 表示服务器过载，请求队列已满
+        HEADER_TOO_LARGE : 表示请求行和请求头超过了读缓冲区的上限
+        METRICS_REQUEST : 请求运行统计，见metrics.h
     */
     enum HTTP_CODE {NO_REQUEST = 0, GET_REQUEST, BAD_REQUEST, NO_RESOURCE,
-                    FORBIDDEN_REQUEST, FILE_REQUEST, INTERNAL_ERROR, CLOSED_CONNECTION};
+                    FORBIDDEN_REQUEST, FILE_REQUEST, INTERNAL_ERROR, CLOSED_CONNECTION,
+                    RANGE_NOT_SATISFIABLE, SERVICE_UNAVAILABLE, HEADER_TOO_LARGE, METRICS_REQUEST};
     /*
         定义有限状态机
         状态机的状态有三种可能，即行的读取状态，分别表示：
@@ -62,15 +81,25 @@ public:
     enum LINE_STATUS {LINE_OK = 0, LINE_BAD, LINE_OPEN};
 
 public:
-    http_conn(){}//构造函数
+    http_conn():m_sockfd(-1), m_generation(0), m_loop(nullptr), m_idle(false), m_read_buf(nullptr), m_read_size(0),
+        m_write_buf(nullptr), m_write_size(0), m_file(nullptr), m_body(nullptr), m_body_size(0){}//构造函数
     ~http_conn(){}//析构函数
 
-    void initNewConn(int sockfd, const sockaddr_in& addr);//初始化新接入的连接
+    void initNewConn(int sockfd, const sockaddr_in& addr, EventLoop* loop);//初始化新接入的连接，连接固定由loop负责
     void closeConn();//关闭连接
     void process();//处理客户端的请求
     bool readRequest();//非阻塞读取客户端发来的请求
     bool writetoClient();//非阻塞写，给客户端回写数据
+    bool hasPendingRequest();//响应发送完毕后读缓冲区中是否还有后续请求的数据
+    bool rejectRequest();//线程池已满时由事件循环直接回复503，不经过工作线程，返回false时需要关闭连接
     const sockaddr_in getClientAddr();
+    EventLoop* getLoop() { return m_loop; }//连接所属的事件循环
+    uint32_t getGeneration() { return m_generation.load(std::memory_order_relaxed); }//连接的代数，每次接入新连接加1
+    bool isIdle() { return m_sockfd != -1 && m_idle; }//长连接是否在等待下一个请求，只在所属事件循环的线程中调用
+    void setStageTime(uint64_t time) { m_stage_time = time; }//当前阶段的开始时间，由事件循环在交给线程池时设置
+    void detachTimer();//交给线程池之前摘下定时器，工作线程处理期间不会超时关闭，只在所属事件循环的线程中调用
+    void attachTimer();//连接交还给事件循环时按原来的到期时刻放回定时器，只在所属事件循环的线程中调用
+    void waitRequest();//请求还没有收完整，继续等待剩余的数据
 
     // void cb_func (int);
     // //处理时间事件
@@ -78,6 +107,13 @@ public:
 
 private:
     void init();//初始化连接
+    void next_generation();//连接的代数加1，之前注册的事件都成为过期事件
+    bool next_request();//保留读缓冲区中后续请求的数据，准备处理下一个请求，无法确定下一个请求的位置时返回false
+    bool grow_read_buf();//读缓冲区满了，扩大一倍，已经解析出的指针指向新的缓冲区
+    bool grow_write_buf(int need);//写缓冲区放不下，扩大到至少need字节，已经加入的段指向新的缓冲区
+    void compact_read_buf();//把当前请求的数据移到读缓冲区开头，腾出前面已经处理完的请求占用的空间
+    void free_read_buf();//把读缓冲区归还内存池
+    void free_write_buf();//把写缓冲区归还内存池
 
     //解析HTTP请求，主状态机解析，先解析请求行，在解析请求头，在解析请求体
     HTTP_CODE process_read();
@@ -85,59 +121,90 @@ private:
     bool process_write(HTTP_CODE ret);
 
     //下面一组函数被process_read用来解析HTTP协议
-    HTTP_CODE parse_request_line(char* text);//解析请求行
-    HTTP_CODE parse_headers(char* text);//解析请求头
-    HTTP_CODE parse_content(char* text);//解析请求体
-    char* get_line(){return m_read_buf + m_start_line;}//获取一行字符串
+    HTTP_CODE parse_request_line(std::string_view text);//解析请求行
+    HTTP_CODE parse_headers(std::string_view text);//解析请求头
+    HTTP_CODE parse_content();//解析请求体，只检查请求体是否已经收完，内容不需要解析
+    std::string_view get_line(){return std::string_view(m_read_buf + m_start_line, m_line_end - m_start_line);}//获取一行，不含行结束符
     LINE_STATUS parse_line();//解析行
     HTTP_CODE do_request();//解析完HTTP请求报文以后，做出响应
+    int parse_range();//根据文件大小解析Range头部，返回范围个数，0表示发送整个文件，-1表示范围无法满足
+    bool if_range_match();//If-Range头部是否与当前文件匹配，不匹配时要发送整个文件
 
     //下面这一组函数被process_write用来调用以填充HTTP应答
-    void unmap();//对内存映射区执行munmap操作
-    bool add_response(const char* format, ...);
-    bool add_content(const char* content);
+    void closeFile();//释放请求的目标文件
+    bool add_text(const char* text, int len);//向写缓冲区追加数据，不经过格式化
+    bool add_text(std::string_view text) { return add_text(text.data(), text.size()); }
+    bool add_number(unsigned long long value);
     bool add_content_type();
-    bool add_status_line(int status, const char* title);
-    bool add_headers(int content_length);
-    bool add_content_length(int content_length);
+    bool add_status_line(std::string_view line);//状态行已经预先生成，包括行结束符
+    bool add_content_length(off_t content_length);
     bool add_linger();
+    bool add_date();
     bool add_blank_line();
+    bool add_content_range(off_t start, off_t end);
+    bool add_file_validators();//Accept-Ranges、ETag和Last-Modified头部
+    bool add_file_response();//填充文件请求的响应，包括200、206和multipart/byteranges
+    bool add_metrics_response();//填充运行统计的响应
+    void add_segment(const char* buf, off_t offset, int len);//向待发送的段中加入一段
+    void log_access();//响应结束时写一条访问日志，并记录运行统计
 
 
 public:
-    static int m_epollfd;//所有的工作都要共享一个epoll内存，一起监听
-    static int m_user_count;//当前所有用户的数量
+    static std::atomic<int> m_user_count;//当前所有用户的数量，多个事件循环同时修改
 
     
 private:
     int m_sockfd;
+    std::atomic<uint32_t> m_generation;//同一个文件描述符被第几个连接使用，注册到epoll中用来识别过期事件
+    int m_epollfd;//连接所属事件循环的epoll实例
+    EventLoop* m_loop;//连接所属的事件循环
+    bool m_idle;//上一个响应已经发送完毕，正在等待下一个请求，排空时可以直接关闭
     sockaddr_in m_address;
-    char m_read_buf[READ_BUFFER_SIZE];//读缓冲区
+    char* m_read_buf;//读缓冲区，没有未处理的数据时为空
+    int m_read_size;//读缓冲区的容量
     int m_read_idx;//标识读缓冲区中已经读入数据的下一个位置
+    int m_request_start;//当前请求在读缓冲区中的起始位置，之前是已经处理完的请求，读缓冲区满了才移走
     int m_checked_idx;//当前正在分析的字符在读缓冲区的位置
     int m_start_line;//当前正在解析的行的起始位置
+    int m_line_end;//parse_line解析出的完整行的结束位置，即\r所在的位置
 
     CHECK_STATE m_check_state;//主状态机当前所处的状态
     METHOD m_method;//请求方法
 
-    char m_real_file[FILENAME_LEN];//客户请求的目标文件的完整路径，其内容等于doc_root + m_url, doc_root是网站的根目录
-    char* m_url;//客户请求的目标文件的文件名
-    char* m_version;//HTTP协议版本号，我们仅仅支持HTTP1.1
-    char* m_host;//主机名
+    http_request m_request;//解析出的请求，各字段指向读缓冲区，Range、If-Range等请求头也从这里获取
     int m_content_length;//HTTP请求的消息总长度
     bool m_linger;//HTTP请求是否要求保持连接
 
-    char m_write_buf[WRITE_BUFFER_SIZE];//写缓冲区
+    char* m_write_buf;//写缓冲区，没有待发送的响应时为空
+    int m_write_size;//写缓冲区的容量
     int m_write_idx;//写缓冲中待发送的字节数
-    char* m_file_address;//客户请求的目标文件被mmap到内存中
+    CachedFile* m_file;//客户请求的目标文件，从文件缓存中获取，用sendfile直接从页缓存发送给客户端，nullptr表示没有文件
+    char* m_body;//不来自文件的消息体，如运行统计，从内存池中申请，与写缓冲区一起释放
+    int m_body_size;//m_body的容量
     struct stat m_file_stat;//目标文件的状态，通过它我们可以判断文件是否存在、是否为目录、是否可读、并获取文件大小等信息,通过文件名filename获取文件信息，并保存在buf所指的结构体stat中
-    struct iovec m_iv[2];//我们采用writev来执行写操作，所以定义下面两个成员，其中m_iv_count表示被写的内存块数量
-    int m_iv_count;
 
-    int bytes_to_send;              // 将要发送的数据的字节数
+    byte_range m_ranges[MAX_RANGES];
+    int m_range_count;//范围个数，0表示发送整个文件
+
+    //响应按段发送，buf不为空的段是写缓冲区中的数据，用send发送；buf为空的段是文件中从offset开始的len个字节，用sendfile发送
+    struct send_segment {
+        const char* buf;
+        off_t offset;
+        int len;
+    };
+    send_segment m_segments[MAX_SEGMENTS];
+    int m_segment_count;//段的个数
+    int m_segment_idx;//当前正在发送的段
+    int m_segment_sent;//当前段已经发送的字节数，跨多轮EPOLLOUT保存
+
+    int bytes_to_send;              // 将要发送的数据的字节数，包括响应头和文件内容
     int bytes_have_send;            // 已经发送的字节数
+    int m_status;//响应的状态码，写入访问日志后清零，0表示没有需要记录的响应
+    uint64_t m_request_time;//收到请求第一个字节的时间，单调时钟的微秒数，用来计算访问日志中的延迟
+    uint64_t m_stage_time;//当前阶段的开始时间，单调时钟的纳秒数，开启统计时才记录，用来计算排队和发送的耗时
 
     utill_timer* m_timer;//定时器
+    timer_wheel* m_timer_wheel;//连接所属事件循环的时间轮
 };
 
 #endif
\ No newline at end of file
@@ -0,0 +1,62 @@
+/*
+    本程序定义解析后的HTTP请求
+    所有字段都是指向连接读缓冲区的string_view，解析时不复制也不在缓冲区中写入字符串结束符；
+    同一个连接上的多个请求（pipelining）复用同一个结构，clear以后重新填充，不申请内存；
+    只记录服务器关心的几个请求头，每个连接都有一份，其他请求头查表后直接跳过；
+    读缓冲区被换成更大的缓冲区或者数据被移动时，由rebase把所有字段指向新的位置
+*/
+#ifndef HTTP_REQUEST_H
+#define HTTP_REQUEST_H
+
+#include <string_view>
+#include "httpscan.h"
+
+struct http_request {
+    std::string_view method;//请求方法，如GET
+    std::string_view target;//请求行中的目标，如/a.mp3?t=1，绝对形式的URL已经去掉了协议和主机
+    std::string_view path;//目标中问号之前的部分
+    std::string_view query;//目标中问号之后的部分，没有问号时为空
+    std::string_view version;//协议版本，如HTTP/1.1
+    std::string_view known[HEADER_IF_RANGE + 1];//服务器关心的请求头的值，按HEADER_NAME索引，去掉了首尾的空白
+
+    http_request() { clear(); }
+
+    void clear() {
+        method = target = path = query = version = std::string_view();
+        for (int i = 0; i <= HEADER_IF_RANGE; ++i) {
+            known[i] = std::string_view();
+        }
+    }
+
+    //记录一个请求头，不关心的请求头不记录，同名的请求头以最后一个为准
+    void add_header(int id, std::string_view value) {
+        if (id != HEADER_UNKNOWN) {
+            known[id] = value;
+        }
+    }
+
+    //服务器关心的请求头的值，没有时返回空的string_view，data()为nullptr
+    std::string_view get(int id) const {
+        return known[id];
+    }
+
+    //读缓冲区从old_base移到了new_base，所有字段按相同的偏移指向新的位置
+    void rebase(const char* old_base, const char* new_base) {
+        std::string_view* views[] = {&method, &target, &path, &query, &version};
+        for (size_t i = 0; i < sizeof(views) / sizeof(views[0]); ++i) {
+            move(*views[i], old_base, new_base);
+        }
+        for (int i = 0; i <= HEADER_IF_RANGE; ++i) {
+            move(known[i], old_base, new_base);
+        }
+    }
+
+private:
+    static void move(std::string_view& view, const char* old_base, const char* new_base) {
+        if (view.data() != nullptr) {
+            view = std::string_view(new_base + (view.data() - old_base), view.size());
+        }
+    }
+};
+
+#endif
@@ -0,0 +1,87 @@
+#include <string.h>
+#include <ctype.h>
+#include <stdlib.h>
+#include "httprange.h"
+
+/*
+    解析Range头部，只支持bytes单位，格式为：
+        bytes=0-499         第0到第499个字节
+        bytes=500-          从第500个字节到文件末尾
+        bytes=-500          文件最后500个字节
+        bytes=0-0,-1        多个范围用逗号分隔
+    语法错误、单位不认识或者范围个数超过max_ranges时忽略Range，发送整个文件；
+    所有范围都超出文件大小时返回-1，由调用者回复416；
+    range后面必须紧跟一个非数字、非空白的字符（请求中是行结束符\r），strtoll和strspn依赖它停下
+*/
+int parse_byte_ranges(std::string_view range, off_t size, byte_range* ranges, int max_ranges) {
+    const char* text = range.data();
+    const char* text_end = text + range.size();//值不以\0结尾，后面是行结束符\r，strtoll和strspn都会在那里停下
+    if (range.size() < 6 || strncasecmp(text, "bytes=", 6) != 0) {
+        return 0;
+    }
+    text += 6;
+
+    int count = 0;
+    while (true) {
+        text += strspn(text, " \t");
+        char* end_ptr = nullptr;
+        off_t start = 0;
+        off_t end = 0;
+        bool satisfiable = true;
+        if (*text == '-') {//后缀范围，请求文件最后n个字节
+            ++text;
+            if (text == text_end || !isdigit(*text)) {
+                return 0;
+            }
+            off_t suffix = strtoll(text, &end_ptr, 10);
+            text = end_ptr;
+            if (suffix == 0 || size == 0) {
+                satisfiable = false;
+            }
+            start = (suffix >= size) ? 0 : size - suffix;
+            end = size - 1;
+        }
+        else {
+            if (text == text_end || !isdigit(*text)) {
+                return 0;
+            }
+            start = strtoll(text, &end_ptr, 10);
+            text = end_ptr;
+            if (text == text_end || *text++ != '-') {
+                return 0;
+            }
+            end = size - 1;//没有结束位置时一直到文件末尾
+            if (text < text_end && isdigit(*text)) {
+                end = strtoll(text, &end_ptr, 10);
+                text = end_ptr;
+                if (end < start) {
+                    return 0;
+                }
+                if (end >= size) {
+                    end = size - 1;
+                }
+            }
+            if (start >= size) {
+                satisfiable = false;
+            }
+        }
+
+        if (satisfiable) {//超出文件大小的范围直接跳过
+            if (count == max_ranges) {
+                return 0;
+            }
+            ranges[count].start = start;
+            ranges[count].end = end;
+            ++count;
+        }
+
+        text += strspn(text, " \t");
+        if (text >= text_end) {
+            break;
+        }
+        if (*text++ != ',') {
+            return 0;
+        }
+    }
+    return (count == 0) ? -1 : count;
+}
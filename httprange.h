@@ -0,0 +1,21 @@
+/*
+    本程序实现HTTP Range头部的解析
+    解析只依赖头部的值和文件大小，不涉及连接状态，单独拿出来便于测试
+*/
+#ifndef HTTPRANGE_H
+#define HTTPRANGE_H
+
+#include <sys/types.h>
+#include <string_view>
+
+//客户请求的字节范围，闭区间
+struct byte_range {
+    off_t start;
+    off_t end;
+};
+
+//解析Range头部的值，结果写入ranges，最多max_ranges个
+//返回范围个数，0表示忽略Range发送整个文件，-1表示所有范围都无法满足
+int parse_byte_ranges(std::string_view range, off_t size, byte_range* ranges, int max_ranges);
+
+#endif
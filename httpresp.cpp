@@ -0,0 +1,94 @@
+#include <string.h>
+#include "httpresp.h"
+
+static const char s_days[7][4] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+static const char s_months[12][4] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun",
+                                     "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+int format_decimal(char* buf, unsigned long long value) {
+    char tmp[MAX_DECIMAL_LEN];
+    int len = 0;
+    do {//从低位开始生成，再倒过来复制
+        tmp[len++] = '0' + value % 10;
+        value /= 10;
+    } while (value != 0);
+    for (int i = 0; i < len; ++i) {
+        buf[i] = tmp[len - 1 - i];
+    }
+    return len;
+}
+
+static int format_hex(char* buf, unsigned long long value) {
+    char tmp[16];
+    int len = 0;
+    do {
+        tmp[len++] = "0123456789abcdef"[value & 15];
+        value >>= 4;
+    } while (value != 0);
+    for (int i = 0; i < len; ++i) {
+        buf[i] = tmp[len - 1 - i];
+    }
+    return len;
+}
+
+//写两位数字，不足两位补0
+static char* put2(char* p, int value) {
+    p[0] = '0' + value / 10;
+    p[1] = '0' + value % 10;
+    return p + 2;
+}
+
+void format_http_date(time_t t, char* buf) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    char* p = buf;
+    memcpy(p, s_days[tm.tm_wday], 3);
+    p += 3;
+    *p++ = ',';
+    *p++ = ' ';
+    p = put2(p, tm.tm_mday);
+    *p++ = ' ';
+    memcpy(p, s_months[tm.tm_mon], 3);
+    p += 3;
+    *p++ = ' ';
+    int year = tm.tm_year + 1900;
+    p = put2(p, year / 100);
+    p = put2(p, year % 100);
+    *p++ = ' ';
+    p = put2(p, tm.tm_hour);
+    *p++ = ':';
+    p = put2(p, tm.tm_min);
+    *p++ = ':';
+    p = put2(p, tm.tm_sec);
+    memcpy(p, " GMT", 5);//连同结束符
+}
+
+int format_etag(const struct stat& st, char* buf) {
+    int len = 0;
+    buf[len++] = '"';
+    len += format_hex(buf + len, (unsigned long)st.st_mtime);
+    buf[len++] = '-';
+    len += format_hex(buf + len, (unsigned long)st.st_size);
+    buf[len++] = '"';
+    buf[len] = '\0';
+    return len;
+}
+
+//每个线程一份，不需要加锁；time在vDSO中实现，不进入内核
+struct DateCache {
+    time_t sec;//header对应的秒数
+    char header[6 + HTTP_DATE_LEN + 3];//Date: 时间\r\n，时间以\0结尾后再覆盖成\r\n
+};
+
+static thread_local DateCache t_date = {-1, "Date: "};
+
+std::string_view http_date_header() {
+    time_t now = time(nullptr);
+    if (now != t_date.sec) {//进入新的一秒，重新生成
+        format_http_date(now, t_date.header + 6);
+        t_date.header[6 + HTTP_DATE_LEN] = '\r';
+        t_date.header[6 + HTTP_DATE_LEN + 1] = '\n';
+        t_date.sec = now;
+    }
+    return std::string_view(t_date.header, 6 + HTTP_DATE_LEN + 2);
+}
@@ -0,0 +1,29 @@
+/*
+    本程序实现HTTP响应头的快速生成
+    响应路径上不再调用snprintf、strftime等格式化函数：数字和时间按固定格式直接写出；
+    Date头部每个线程缓存一份，秒数变化时才重新生成，同一秒内的响应直接复制
+*/
+#ifndef HTTPRESP_H
+#define HTTPRESP_H
+
+#include <time.h>
+#include <sys/stat.h>
+#include <string_view>
+
+#define HTTP_DATE_LEN 29 // HTTP时间的长度，如Sun, 06 Nov 1994 08:49:37 GMT
+#define MAX_DECIMAL_LEN 20 // 64位无符号整数的最大十进制位数
+#define MAX_ETAG_LEN 36 // ETag的最大长度，两个64位十六进制数加上引号和连字符
+
+//把value按十进制写入buf，不写结束符，返回长度
+int format_decimal(char* buf, unsigned long long value);
+
+//把t按HTTP时间格式写入buf，buf至少HTTP_DATE_LEN+1字节，以\0结尾
+void format_http_date(time_t t, char* buf);
+
+//生成文件的ETag，由修改时间和文件大小组成，如"5f1c2a3b-4a3f20"，buf至少MAX_ETAG_LEN+1字节，以\0结尾，返回长度
+int format_etag(const struct stat& st, char* buf);
+
+//当前时间的Date头部，包括行结束符，如Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n，只在调用线程中有效
+std::string_view http_date_header();
+
+#endif
@@ -0,0 +1,115 @@
+#include <string.h>
+#include <strings.h>
+#include "httpscan.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define HTTPSCAN_X86
+#endif
+
+static const char* scan_scalar(const char* p, const char* end) {
+    for (; p < end; ++p) {
+        if (*p == '\r' || *p == '\n') {
+            return p;
+        }
+    }
+    return end;
+}
+
+#ifdef HTTPSCAN_X86
+//每次比较32个字节，两个比较结果合并后用movemask取出第一个命中的位置
+__attribute__((target("avx2")))
+static const char* scan_avx2(const char* p, const char* end) {
+    const __m256i cr = _mm256_set1_epi8('\r');
+    const __m256i lf = _mm256_set1_epi8('\n');
+    while (end - p >= 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i*)p);
+        unsigned int mask = _mm256_movemask_epi8(_mm256_or_si256(_mm256_cmpeq_epi8(v, cr), _mm256_cmpeq_epi8(v, lf)));
+        if (mask != 0) {
+            return p + __builtin_ctz(mask);
+        }
+        p += 32;
+    }
+    return scan_scalar(p, end);//不足32字节的尾部逐字节查找，不越过缓冲区末尾
+}
+
+//pcmpestri一次在16个字节中查找字符集合{'\r', '\n'}中的任意一个，返回第一个命中的下标
+__attribute__((target("sse4.2")))
+static const char* scan_sse42(const char* p, const char* end) {
+    const __m128i set = _mm_setr_epi8('\r', '\n', 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0);
+    while (end - p >= 16) {
+        __m128i v = _mm_loadu_si128((const __m128i*)p);
+        int idx = _mm_cmpestri(set, 2, v, 16, _SIDD_UBYTE_OPS | _SIDD_CMP_EQUAL_ANY | _SIDD_LEAST_SIGNIFICANT);
+        if (idx != 16) {
+            return p + idx;
+        }
+        p += 16;
+    }
+    return scan_scalar(p, end);
+}
+#endif
+
+typedef const char* (*scan_func)(const char*, const char*);
+
+struct ScanImpl {
+    scan_func func;
+    const char* name;
+};
+
+//启动时选择一次，之后每次调用只是一次间接跳转
+static ScanImpl choose_impl() {
+#ifdef HTTPSCAN_X86
+    __builtin_cpu_init();//静态初始化阶段调用，需要先初始化CPU信息
+    if (__builtin_cpu_supports("avx2")) {
+        return ScanImpl{scan_avx2, "avx2"};
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        return ScanImpl{scan_sse42, "sse4.2"};
+    }
+#endif
+    return ScanImpl{scan_scalar, "scalar"};
+}
+
+static const ScanImpl s_impl = choose_impl();
+
+const char* scan_line_end(const char* begin, const char* end) {
+    return s_impl.func(begin, end);
+}
+
+const char* scan_impl_name() {
+    return s_impl.name;
+}
+
+/*
+    请求头名称的完美哈希：(长度 + 首字母 + 尾字母) & 15，字母统一转成小写
+        connection      10 + 'c' + 'n' = 219 -> 11
+        content-length  14 + 'c' + 'h' = 217 -> 9
+        host             4 + 'h' + 't' = 224 -> 0
+        range            5 + 'r' + 'e' = 220 -> 12
+        if-range         8 + 'i' + 'e' = 214 -> 6
+    五个名称落在不同的槽中，命中的槽再用strncasecmp确认一次
+*/
+struct HeaderEntry {
+    const char* name;
+    int len;
+    int id;
+};
+
+static const HeaderEntry s_headers[16] = {
+    {"host", 4, HEADER_HOST}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0},
+    {0, 0, 0}, {0, 0, 0}, {"if-range", 8, HEADER_IF_RANGE}, {0, 0, 0},
+    {0, 0, 0}, {"content-length", 14, HEADER_CONTENT_LENGTH}, {0, 0, 0}, {"connection", 10, HEADER_CONNECTION},
+    {"range", 5, HEADER_RANGE}, {0, 0, 0}, {0, 0, 0}, {0, 0, 0},
+};
+
+int lookup_header(const char* name, int len) {
+    if (len <= 0) {
+        return HEADER_UNKNOWN;
+    }
+    int slot = (len + (name[0] | 0x20) + (name[len - 1] | 0x20)) & 15;
+    const HeaderEntry& entry = s_headers[slot];
+    if (entry.len != len || strncasecmp(name, entry.name, len) != 0) {
+        return HEADER_UNKNOWN;
+    }
+    return entry.id;
+}
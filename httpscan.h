@@ -0,0 +1,22 @@
+/*
+    本程序实现HTTP请求的快速扫描
+    查找行结束符时一次比较16或32个字节：启动时检测CPU，支持AVX2用AVX2，支持SSE4.2用pcmpestri，否则逐字节查找；
+    请求头名称用完美哈希查表，每个请求头最多比较一次字符串，不再依次调用strncasecmp
+*/
+#ifndef HTTPSCAN_H
+#define HTTPSCAN_H
+
+//服务器关心的请求头，其他请求头为HEADER_UNKNOWN
+enum HEADER_NAME {HEADER_UNKNOWN = 0, HEADER_CONNECTION, HEADER_CONTENT_LENGTH, HEADER_HOST,
+                  HEADER_RANGE, HEADER_IF_RANGE};
+
+//返回[begin, end)中第一个'\r'或'\n'的位置，没有时返回end
+const char* scan_line_end(const char* begin, const char* end);
+
+//请求头名称（不含冒号）对应的HEADER_NAME，不区分大小写
+int lookup_header(const char* name, int len);
+
+//当前使用的扫描实现，"avx2"、"sse4.2"或"scalar"，用于启动日志
+const char* scan_impl_name();
+
+#endif
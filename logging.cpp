@@ -0,0 +1,22 @@
+#include <string.h>
+#include "logging.h"
+
+int log_level = LOG_LEVEL_INFO;
+
+static const char* const s_level_names[] = {"trace", "debug", "info", "warn", "error", "off"};
+
+int parse_log_level(const char* name) {
+    for (int i = LOG_LEVEL_TRACE; i <= LOG_LEVEL_OFF; ++i) {
+        if (strcmp(name, s_level_names[i]) == 0) {
+            return i;
+        }
+    }
+    return -1;
+}
+
+const char* log_level_name(int level) {
+    if (level < LOG_LEVEL_TRACE || level > LOG_LEVEL_OFF) {
+        return "unknown";
+    }
+    return s_level_names[level];
+}
@@ -0,0 +1,70 @@
+/*
+    本程序实现分级日志，在CLogFile之上按TRACE、DEBUG、INFO、WARN、ERROR分为五级
+    编译期阈值LOG_COMPILE_LEVEL以下的级别宏展开为空，参数不会被求值，也不会生成任何代码，
+    编译时用make LOG_LEVEL=TRACE等打开；
+    运行期阈值log_level由-L参数设置，低于阈值的日志在调用Write之前就返回，不会格式化参数
+*/
+#ifndef LOGGING_H
+#define LOGGING_H
+
+#include "_freecplus.h"
+
+#define LOG_LEVEL_TRACE 0 // 每次读写的细节，只在排查问题时打开
+#define LOG_LEVEL_DEBUG 1 // 每个连接的建立和关闭
+#define LOG_LEVEL_INFO 2 // 启动、退出等运行状态的变化
+#define LOG_LEVEL_WARN 3 // 过载、丢弃等不影响继续服务的问题
+#define LOG_LEVEL_ERROR 4 // 系统调用失败等错误
+#define LOG_LEVEL_OFF 5 // 关闭所有分级日志
+
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL LOG_LEVEL_INFO
+#endif
+
+extern CLogFile logfile;
+extern int log_level;//运行期阈值，启动工作线程之前设置，之后只读
+
+//把级别名称trace、debug、info、warn、error转换为级别，名称不正确时返回-1
+int parse_log_level(const char* name);
+
+//级别的名称，用于启动时记录当前的阈值
+const char* log_level_name(int level);
+
+//级别达到运行期阈值时才调用Write，参数在判断之后才求值
+#define LOG_AT(level, ...) \
+    do { \
+        if (__builtin_expect((level) >= log_level, 0)) { \
+            logfile.Write(__VA_ARGS__); \
+        } \
+    } while (0)
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_TRACE
+#define LOG_TRACE(...) LOG_AT(LOG_LEVEL_TRACE, __VA_ARGS__)
+#else
+#define LOG_TRACE(...) ((void)0)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_DEBUG
+#define LOG_DEBUG(...) LOG_AT(LOG_LEVEL_DEBUG, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void)0)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_INFO
+#define LOG_INFO(...) LOG_AT(LOG_LEVEL_INFO, __VA_ARGS__)
+#else
+#define LOG_INFO(...) ((void)0)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_WARN
+#define LOG_WARN(...) LOG_AT(LOG_LEVEL_WARN, __VA_ARGS__)
+#else
+#define LOG_WARN(...) ((void)0)
+#endif
+
+#if LOG_COMPILE_LEVEL <= LOG_LEVEL_ERROR
+#define LOG_ERROR(...) LOG_AT(LOG_LEVEL_ERROR, __VA_ARGS__)
+#else
+#define LOG_ERROR(...) ((void)0)
+#endif
+
+#endif
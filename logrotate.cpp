@@ -0,0 +1,221 @@
+#include <unistd.h>
+#include <dirent.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <zlib.h>
+#include <vector>
+#include <algorithm>
+#include "logrotate.h"
+#include "_freecplus.h"
+
+LogRotator::LogRotator() : m_max_bytes(0), m_period(LOG_PERIOD_NONE), m_keep(0), m_next_rotate(0),
+    m_stop(false), m_running(false) {}
+
+LogRotator::~LogRotator() {
+    stop();
+}
+
+bool LogRotator::init(const char* filename, long max_bytes, int period, int keep) {
+    m_filename = filename;
+    m_max_bytes = max_bytes;
+    m_period = period;
+    m_keep = keep;
+    m_next_rotate = next_boundary(time(nullptr));
+    m_stop = false;
+    if (pthread_create(&m_thread, nullptr, worker, this) != 0) {
+        return false;
+    }
+    m_running = true;
+    return true;
+}
+
+time_t LogRotator::next_boundary(time_t now) {
+    if (m_period == LOG_PERIOD_NONE) {
+        return 0;
+    }
+    struct tm tm;
+    localtime_r(&now, &tm);
+    tm.tm_min = 0;
+    tm.tm_sec = 0;
+    if (m_period == LOG_PERIOD_HOUR) {
+        tm.tm_hour += 1;
+    }
+    else {
+        tm.tm_hour = 0;
+        tm.tm_mday += 1;//mktime会处理月末和年末
+    }
+    tm.tm_isdst = -1;//由mktime判断夏令时
+    return mktime(&tm);
+}
+
+bool LogRotator::due(long bytes, time_t now) {
+    if (m_max_bytes > 0 && bytes > m_max_bytes) {
+        return true;
+    }
+    if (m_next_rotate != 0 && now >= m_next_rotate) {
+        if (bytes > 0) {
+            return true;
+        }
+        m_next_rotate = next_boundary(now);//这个周期没有写入任何内容，不切换出空文件
+    }
+    return false;
+}
+
+void LogRotator::rotate(time_t now) {
+    //历史文件名与CLogFile::BackupLogFile相同，在日志文件名后加上日期时间，同一秒内多次切换时再加序号
+    char strLocalTime[21];
+    memset(strLocalTime, 0, sizeof(strLocalTime));
+    timetostr(now, strLocalTime, "yyyymmddhh24miss");
+    std::string bak_filename = m_filename + "." + strLocalTime;
+    struct stat st;
+    for (int i = 1; stat(bak_filename.c_str(), &st) == 0 || stat((bak_filename + ".gz").c_str(), &st) == 0; ++i) {
+        bak_filename = m_filename + "." + strLocalTime + "." + std::to_string(i);
+    }
+    if (rename(m_filename.c_str(), bak_filename.c_str()) != 0) {
+        return;
+    }
+    m_next_rotate = next_boundary(now);
+
+    m_locker.lock();
+    m_pending.push_back(bak_filename);
+    m_locker.unlock();
+    m_cond.signal();
+}
+
+void LogRotator::stop() {
+    if (!m_running) {
+        return;
+    }
+    m_locker.lock();
+    m_stop = true;
+    m_locker.unlock();
+    m_cond.signal();
+    pthread_join(m_thread, nullptr);
+    m_running = false;
+}
+
+void* LogRotator::worker(void* arg) {
+    ((LogRotator*)arg)->run();
+    return nullptr;
+}
+
+void LogRotator::run() {
+    while (true) {
+        m_locker.lock();
+        while (m_pending.empty() && !m_stop) {
+            m_cond.wait(m_locker.getLocker());
+        }
+        if (m_pending.empty()) {//已经停止，并且没有等待压缩的文件
+            m_locker.unlock();
+            break;
+        }
+        std::string path = m_pending.front();
+        m_pending.pop_front();
+        m_locker.unlock();
+
+        compress(path);
+        prune();
+    }
+}
+
+void LogRotator::compress(const std::string& path) {
+    FILE* in = fopen(path.c_str(), "rb");
+    if (in == nullptr) {
+        return;
+    }
+    //先写到临时文件，压缩完整以后再改名，进程中途退出时不会留下不完整的.gz文件
+    std::string gz_tmp = path + ".gz.tmp";
+    gzFile out = gzopen(gz_tmp.c_str(), "wb6");
+    if (out == nullptr) {
+        fclose(in);
+        return;
+    }
+    char buf[65536];
+    size_t n = 0;
+    bool ok = true;
+    while ((n = fread(buf, 1, sizeof(buf), in)) > 0) {
+        if (gzwrite(out, buf, n) != (int)n) {
+            ok = false;
+            break;
+        }
+    }
+    ok = ok && !ferror(in);
+    fclose(in);
+    if (gzclose(out) != Z_OK || !ok) {//磁盘满等，保留未压缩的历史文件
+        unlink(gz_tmp.c_str());
+        return;
+    }
+    if (rename(gz_tmp.c_str(), (path + ".gz").c_str()) == 0) {
+        unlink(path.c_str());
+    }
+}
+
+//去掉历史文件名的.gz后缀
+static std::string strip_gz(const std::string& name) {
+    if (name.size() > 3 && name.compare(name.size() - 3, 3, ".gz") == 0) {
+        return name.substr(0, name.size() - 3);
+    }
+    return name;
+}
+
+//历史文件a是否比b先切换出来，offset为日志文件名加上"."的长度
+//先比较14位日期时间，同一秒内再按序号的数值比较，没有序号的最先；不能直接比较字符串，否则.10会排在.2前面
+static bool backup_before(const std::string& a, const std::string& b, size_t offset) {
+    std::string ka = strip_gz(a).substr(offset);
+    std::string kb = strip_gz(b).substr(offset);
+    int cmp = ka.compare(0, 14, kb, 0, 14);
+    if (cmp != 0) {
+        return cmp < 0;
+    }
+    long seq_a = (ka.size() > 15) ? strtol(ka.c_str() + 15, nullptr, 10) : 0;
+    long seq_b = (kb.size() > 15) ? strtol(kb.c_str() + 15, nullptr, 10) : 0;
+    return seq_a < seq_b;
+}
+
+//是否是切换出的历史文件：日志文件名.14位日期时间[.序号][.gz]
+static bool is_backup(const std::string& name, const std::string& base) {
+    if (name.compare(0, base.size() + 1, base + ".") != 0) {
+        return false;
+    }
+    std::string rest = strip_gz(name).substr(base.size() + 1);
+    if (rest.size() < 14 || rest.find_first_not_of("0123456789") < 14) {
+        return false;
+    }
+    if (rest.size() == 14) {
+        return true;
+    }
+    return rest[14] == '.' && rest.size() > 15 && rest.find_first_not_of("0123456789", 15) == std::string::npos;
+}
+
+void LogRotator::prune() {
+    if (m_keep <= 0) {
+        return;
+    }
+    size_t slash = m_filename.rfind('/');
+    std::string dir = (slash == std::string::npos) ? "." : m_filename.substr(0, slash);
+    std::string base = (slash == std::string::npos) ? m_filename : m_filename.substr(slash + 1);
+    DIR* dp = opendir(dir.empty() ? "/" : dir.c_str());
+    if (dp == nullptr) {
+        return;
+    }
+    std::vector<std::string> backups;
+    struct dirent* entry = nullptr;
+    while ((entry = readdir(dp)) != nullptr) {
+        if (is_backup(entry->d_name, base)) {
+            backups.push_back(entry->d_name);
+        }
+    }
+    closedir(dp);
+    if ((int)backups.size() <= m_keep) {
+        return;
+    }
+    size_t offset = base.size() + 1;
+    std::sort(backups.begin(), backups.end(), [offset](const std::string& a, const std::string& b) {
+        return backup_before(a, b, offset);
+    });
+    for (size_t i = 0; i + m_keep < backups.size(); ++i) {//最旧的在前面
+        unlink((dir + "/" + backups[i]).c_str());
+    }
+}
@@ -0,0 +1,56 @@
+/*
+    本程序实现日志文件的切换策略，由AsyncLog的后台线程使用
+    文件大小由写入者在内存中累计，超过上限时切换，不需要每次写入都调用fseek和ftell；
+    也可以按小时或者按天切换，过了下一个整点或者零点以后第一次写入前切换，没有写入任何内容的文件不切换；
+    切换出的历史文件在压缩线程中用gzip压缩，压缩完删除原文件，写日志的线程不等待压缩；
+    保留的历史文件个数有上限时，每次压缩完删除最旧的历史文件
+*/
+#ifndef LOGROTATE_H
+#define LOGROTATE_H
+
+#include <time.h>
+#include <string>
+#include <deque>
+#include <pthread.h>
+#include "locker.h"
+#include "cond.h"
+
+//按时间切换的周期
+enum LOG_PERIOD {LOG_PERIOD_NONE = 0, LOG_PERIOD_HOUR, LOG_PERIOD_DAY};
+
+class LogRotator {
+public:
+    LogRotator();//构造函数
+    ~LogRotator();//析构函数，会调用stop
+
+    //filename为当前日志文件，max_bytes为大小上限，0表示不按大小切换，keep为保留的历史文件个数，0表示不限
+    bool init(const char* filename, long max_bytes, int period, int keep);
+    //当前文件已经写入了bytes字节，now时是否需要切换，只比较内存中的值
+    bool due(long bytes, time_t now);
+    //把当前日志文件改名为历史文件，交给压缩线程，调用者要先关闭、之后重新打开日志文件
+    void rotate(time_t now);
+    //等待压缩线程处理完已经切换出的文件后退出
+    void stop();
+
+private:
+    time_t next_boundary(time_t now);//now之后的下一个整点或者零点
+    static void* worker(void* arg);
+    void run();
+    void compress(const std::string& path);//压缩成path.gz，成功后删除path
+    void prune();//删除超出保留个数的历史文件
+
+private:
+    std::string m_filename;
+    long m_max_bytes;
+    int m_period;
+    int m_keep;
+    time_t m_next_rotate;//下一次按时间切换的时刻，0表示不按时间切换
+    std::deque<std::string> m_pending;//等待压缩的历史文件
+    Locker m_locker;//保护m_pending和m_stop
+    COND m_cond;
+    bool m_stop;
+    bool m_running;
+    pthread_t m_thread;
+};
+
+#endif
@@ -2,6 +2,10 @@
     web服务器的主程序，采用模拟proactor模式
     主线程主要进行监听，来进行数据读写；
     将准备好的数据发送给工作线程来处理
+    使用-r参数开启多reactor模式：主线程只负责接收连接，
+    每个子循环拥有独立的epoll实例，负责分配给它的连接的数据读写
+    收到SIGTERM或SIGINT时优雅退出：停止接收新连接，处理完已有的请求后退出；
+    使用-u参数开启热重启：新进程通过Unix域套接字从旧进程接管监听套接字，旧进程随后优雅退出
 */
 #include <iostream>
 #include <arpa/inet.h>
@@ -13,25 +17,24 @@
 #include <error.h>
 #include <string.h>
 #include <signal.h>
+#include <sys/signalfd.h>
+#include <sys/resource.h>
 #include <assert.h>
 #include "http_conn.h"
 #include "threadpool.h"
-#include "_freecplus.h"
+#include "eventloop.h"
+#include "filecache.h"
+#include "handoff.h"
+#include "bufpool.h"
+#include "conntable.h"
+#include "httpscan.h"
+#include "asynclog.h"
+#include "accesslog.h"
+#include "metrics.h"
+#include "logging.h"
 
 using namespace std;
 
-#define MAX_EVENT_NUMBER 500  // 监听的最大的事件数量
-#define MAX_FD 1000 // 最大文件描述符个数
-
-
-extern int setNoBlock (int fd);
-extern void adfd (int epollfd, int fd, bool oneshoot);
-extern void removefd (int epollfd, int fd);
-extern void modfd (int epollfd, int fd, int ev);
-extern void deal_timer ();
-static int pipefd[2];
-
-
 //信号捕捉，当客户端断开以后，防止服务器还持续的向客户端发送数据
 void addsig () {
     struct sigaction act;
@@ -41,198 +44,331 @@ void addsig () {
     sigaction(SIGPIPE, &act, nullptr);//捕捉信号
 }
 
-void sig_handler (int sig) {
-    int save_errno = errno;
-    int msg = sig;
-    send(pipefd[1], (char*)&msg, 1, 0);
-    errno = save_errno;
-}
+CLogFile logfile;
+AsyncLog asynclog;//-a开启异步日志时logfile的写入后端
+AccessLog accesslog;//-l开启的二进制访问日志
+FileCache filecache;//所有线程共享的文件缓存
+BufPool bufpool;//所有连接的读写缓冲区从这里申请
+Metrics metrics;//-m开启的运行统计
+
+//创建监听套接字并绑定端口，reuseport为true时开启SO_REUSEPORT，允许多个套接字监听同一端口
+//backlog为全连接队列的长度，实际值还受内核参数net.core.somaxconn限制
+int createListenFd (int port, bool reuseport, int backlog) {
+    //socket通信，TCP协议，创建时直接指定非阻塞
+    int listenfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);//创建监听套接字
+    if (listenfd == -1) {
+        LOG_ERROR("\tCreate listen socket failed\n");
+        return -1;
+    }
+    //设置端口复用，由内核把新连接分散到监听同一端口的各个套接字上
+    if (reuseport) {
+        int opt = 1;
+        int res = setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
+        if (res == -1) {
+            LOG_ERROR("\tSet port multiplexing failed\n");
+            close(listenfd);
+            return -1;
+        }
+    }
+
+    int res = 0;
+    sockaddr_in saddr;//服务器地址和端口
+    saddr.sin_family = AF_INET;
+    saddr.sin_port = htons(port);//定死服务器端口
+    saddr.sin_addr.s_addr = INADDR_ANY;//本机任何一个ip
+    res = bind(listenfd, (const sockaddr*)&saddr, sizeof(saddr));//绑定端口
+    if (res == -1) {
+        LOG_ERROR("\tBind port failed\n");
+        close(listenfd);
+        return -1;
+    }
 
-void addSig (int sig) {
-    struct sigaction sa;
-    memset(&sa, '\0', sizeof(sa));
-    sa.sa_handler = sig_handler;
-    sa.sa_flags |= SA_RESTART;  // 如果系统调用被中断，则信号处理完成之后会继续系统调用
-    sigfillset(&sa.sa_mask);
-    assert(sigaction(sig, &sa, nullptr) != -1);
+    res = listen(listenfd, backlog);//开始监听
+    if (res == -1) {
+        LOG_ERROR("\tListen failed\n");
+        close(listenfd);
+        return -1;
+    }
+    return listenfd;
 }
 
-CLogFile logfile;
+//把文件描述符的软限制提高到硬限制，返回提高后的软限制，也就是连接表的容量
+int raiseFdLimit () {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == -1) {
+        return MAX_CONN_TABLE_SIZE;
+    }
+    if (rl.rlim_max == RLIM_INFINITY || rl.rlim_max > MAX_CONN_TABLE_SIZE) {
+        rl.rlim_max = MAX_CONN_TABLE_SIZE;
+    }
+    if (rl.rlim_cur == RLIM_INFINITY || rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        if (setrlimit(RLIMIT_NOFILE, &rl) == -1) {
+            getrlimit(RLIMIT_NOFILE, &rl);//提高失败，使用原来的软限制
+        }
+    }
+    return (rl.rlim_cur == RLIM_INFINITY || rl.rlim_cur > MAX_CONN_TABLE_SIZE) ? MAX_CONN_TABLE_SIZE : (int)rl.rlim_cur;
+}
 
 /*主函数*/
 int main (int argc, char* argv[]) {
 
-    if (argc <= 2) {
-        cout << "Format：./server 端口号 日志路径\nSample: ./server 5005 /tmp/server.log\n" << endl;
+    int reactor_number = 0;//子循环数量，0表示单reactor模式
+    bool shard_listen = false;//是否每个子循环独占一个SO_REUSEPORT监听套接字
+    int backlog = SOMAXCONN;//监听队列长度
+    int cache_mb = 256;//文件缓存的大小，单位M，0表示不缓存
+    int thread_number = sysconf(_SC_NPROCESSORS_ONLN);//工作线程数量，缺省为CPU核数
+    bool inbox_stealing = false;//工作线程是否使用各自的收件队列并互相窃取任务
+    const char* handoff_path = nullptr;//热重启时交接监听套接字的Unix域套接字路径，为空时不支持热重启
+    bool async_log = false;//是否由后台线程写日志
+    const char* access_log_path = nullptr;//二进制访问日志的路径，为空时不记录
+    int log_period = LOG_PERIOD_NONE;//后台线程写的日志按时间切换的周期
+    int log_keep = 0;//保留的历史日志文件个数，0表示不限
+    int level = LOG_LEVEL_INFO;//运行期的日志级别
+    bool enable_metrics = false;//是否记录运行统计并通过/metrics导出
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "r:sb:c:t:wu:al:R:k:L:m")) != -1) {
+        switch (opt) {
+            case 'r' : {
+                reactor_number = atoi(optarg);
+                break;
+            }
+            case 's' : {
+                shard_listen = true;
+                break;
+            }
+            case 'b' : {
+                backlog = atoi(optarg);
+                break;
+            }
+            case 'c' : {
+                cache_mb = atoi(optarg);
+                break;
+            }
+            case 't' : {
+                thread_number = atoi(optarg);
+                break;
+            }
+            case 'w' : {
+                inbox_stealing = true;
+                break;
+            }
+            case 'u' : {
+                handoff_path = optarg;
+                break;
+            }
+            case 'a' : {
+                async_log = true;
+                break;
+            }
+            case 'l' : {
+                access_log_path = optarg;
+                break;
+            }
+            case 'R' : {
+                if (strcmp(optarg, "hour") == 0) {
+                    log_period = LOG_PERIOD_HOUR;
+                }
+                else if (strcmp(optarg, "day") == 0) {
+                    log_period = LOG_PERIOD_DAY;
+                }
+                else {
+                    log_period = -1;
+                }
+                break;
+            }
+            case 'k' : {
+                log_keep = atoi(optarg);
+                break;
+            }
+            case 'L' : {
+                level = parse_log_level(optarg);
+                break;
+            }
+            case 'm' : {
+                enable_metrics = true;
+                break;
+            }
+            default : {
+                break;
+            }
+        }
+    }
+
+    if (argc - optind < 2 || reactor_number < 0 || backlog <= 0 || cache_mb < 0 || thread_number <= 0 || log_period < 0 || log_keep < 0 || level < 0) {
+        cout << "Format：./server 端口号 日志路径 [-r 子循环数量] [-s] [-b 监听队列长度] [-c 文件缓存大小(M)] [-t 工作线程数量] [-w] [-u 热重启套接字路径] [-a] [-l 访问日志路径] [-R hour|day] [-k 保留的历史日志个数] [-L trace|debug|info|warn|error] [-m]\nSample: ./server 5005 /tmp/server.log -r 4 -s -b 1024 -c 256 -t 8 -w -u /tmp/server.sock -a -l /tmp/access.log -R day -k 30 -L info -m\n" << endl;
         return 1;
     }
 
-    if(logfile.Open(argv[2]) == false){
-        printf("log open %s failed.\n", argv[2]);
+    if(logfile.Open(argv[optind + 1]) == false){
+        printf("log open %s failed.\n", argv[optind + 1]);
         return -1;
     }
 
-    logfile.Write("\tServer start.\n");
+    log_level = level;
+    LOG_INFO("\tServer start.\n");
+    if (log_level < LOG_COMPILE_LEVEL) {//低于编译期阈值的日志已经被去掉，设置了也不会输出
+        LOG_WARN("\tLog level %s is compiled out, rebuild with make LOG_LEVEL=TRACE to enable it\n", log_level_name(log_level));
+    }
 
-    int userport = atoi(argv[1]);//将字符串端口转换为整数端口
+    int userport = atoi(argv[optind]);//将字符串端口转换为整数端口
 
     //进行信号捕捉
     addsig();
 
+    //SIGTERM和SIGINT由主循环通过signalfd处理，要在创建其他线程之前屏蔽，新线程会继承信号掩码
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGTERM);
+    sigaddset(&mask, SIGINT);
+    sigprocmask(SIG_BLOCK, &mask, nullptr);
+    int sigfd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC);
+    if (sigfd == -1) {
+        LOG_ERROR("\tCreate signalfd failed\n");
+        return 1;
+    }
+
+    //异步日志：写日志的线程只把日志复制到自己的缓冲区，由后台线程批量写入文件
+    //后台线程要在屏蔽信号以后创建，SIGTERM和SIGINT只能由signalfd接收
+    if (async_log) {
+        asynclog.setRotation(log_period, log_keep);
+        if (asynclog.start(argv[optind + 1], logfile.m_MaxLogSize * 1024 * 1024, logfile.m_bBackup)) {
+            logfile.SetSink(&asynclog);
+            LOG_INFO("\tAsync log start\n");
+        }
+        else {
+            LOG_WARN("\tStart async log failed, write log synchronously\n");
+        }
+    }
+    //访问日志：每个响应结束时写一条二进制记录，用tools/accesslog_decode解码
+    if (access_log_path != nullptr && !accesslog.open(access_log_path, logfile.m_MaxLogSize * 1024 * 1024, log_period, log_keep)) {
+        LOG_ERROR("\tOpen access log %s failed\n", access_log_path);
+        return 1;
+    }
+
+    shard_listen = shard_listen && reactor_number > 0;
+    //热重启：如果有旧进程在运行，从它那里接管监听套接字，否则自己创建
+    vector<int> inherited;
+    if (handoff_path != nullptr) {
+        int res = requestHandoff(handoff_path, shard_listen ? reactor_number : 1, &inherited);
+        if (res == -1) {
+            LOG_ERROR("\tTake over listen sockets from %s failed\n", handoff_path);
+            return 1;
+        }
+        if (res == 1) {
+            LOG_INFO("\tTake over %d listen sockets from old process\n", (int)inherited.size());
+        }
+    }
+
     ThreadPool<http_conn> * threadpool = nullptr;//创建线程池指针
     try {
-        threadpool = new ThreadPool<http_conn>(2, 500);
-        logfile.Write("\tCreate %d threads success\n", threadpool->get_thread_number());
+        threadpool = new ThreadPool<http_conn>(thread_number, 500, inbox_stealing);
+        LOG_INFO("\tCreate %d threads success\n", threadpool->get_thread_number());
     }
     catch (...) {
-        logfile.Write("\tCreate threadpool failed\n");
+        LOG_ERROR("\tCreate threadpool failed\n");
         return 1;
     }
+    if (enable_metrics) {//事件循环还没有启动，工作线程还没有收到请求
+        metrics.enable(threadpool);
+        LOG_INFO("\tMetrics enabled at %s\n", METRICS_PATH);
+    }
 
-    http_conn* users = new http_conn[MAX_FD];//最大客户端数量，最大监听文件描述符
+    //连接表按文件描述符索引，容量等于文件描述符的上限，连接按块在第一次使用时分配
+    int max_fd = raiseFdLimit();
+    ConnTable* users = new ConnTable(max_fd);
+    LOG_INFO("\tConnection table capacity %d\n", users->capacity());
+    LOG_INFO("\tHTTP scanner: %s\n", scan_impl_name());
 
-    //socket通信，TCP协议
-    int listenfd = socket(AF_INET, SOCK_STREAM, 0);//创建监听套接字
-    if (listenfd == -1) {
-        logfile.Write("\tCreate listen socket failed\n");
+    filecache.init((size_t)cache_mb * 1024 * 1024);
+
+    //主循环：负责接收新连接和定时信号，单reactor模式下同时负责所有连接的读写
+    EventLoop baseloop;
+    if (!baseloop.init(0, users, threadpool)) {
+        LOG_ERROR("\tCreate epoll failed\n");
         exit(-1);
     }
-    //设置端口复用
-    // int opt = 1;
-    // int res = setsockopt(listenfd, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt));
-    // if (res == -1) {
-    //     logfile.Write("\tSet port multiplexing failed\n");
-    //     exit(-1);
-    // }
 
-    int res = 0;
-    sockaddr_in saddr;//服务器地址和端口
-    saddr.sin_family = AF_INET;
-    saddr.sin_port = htons(userport);//定死服务器端口
-    saddr.sin_addr.s_addr = INADDR_ANY;//本机任何一个ip
-    res = bind(listenfd, (const sockaddr*)&saddr, sizeof(saddr));//绑定端口
-    if (res == -1) {
-        logfile.Write("\tBind port failed\n");
-        return -1;
+    //多reactor模式：每个子循环一个线程、一个epoll实例，连接轮询分配给子循环
+    //监听分片模式：每个子循环独占一个SO_REUSEPORT监听套接字，由内核分配新连接，主循环不再接收连接
+    vector<int> listenfds;
+    vector<EventLoop*> subloops;
+    for (int i = 0; i < reactor_number; ++i) {
+        EventLoop* loop = new EventLoop;
+        if (!loop->init(i + 1, users, threadpool)) {
+            LOG_ERROR("\tCreate event loop %d failed\n", i);
+            exit(-1);
+        }
+        if (shard_listen) {
+            int listenfd = inherited.empty() ? createListenFd(userport, true, backlog) : inherited[i];
+            if (listenfd == -1) {
+                exit(-1);
+            }
+            listenfds.push_back(listenfd);
+            loop->setListenFd(listenfd);
+        }
+        if (!loop->startThread()) {
+            LOG_ERROR("\tCreate event loop %d failed\n", i);
+            exit(-1);
+        }
+        subloops.push_back(loop);
     }
-
-    res = listen(listenfd, 5);//开始监听
-    if (res == -1) {
-        logfile.Write("\tListen failed\n");
-        exit(-1);
+    if (!shard_listen) {//由主循环统一接收新连接，再轮询分配给子循环
+        int listenfd = inherited.empty() ? createListenFd(userport, false, backlog) : inherited[0];
+        if (listenfd == -1) {
+            exit(-1);
+        }
+        listenfds.push_back(listenfd);
+        baseloop.setListenFd(listenfd);
     }
+    baseloop.setSubLoops(&subloops);//排空时由主循环通知子循环
+    LOG_INFO("\tStart %d sub reactors, %d listen sockets\n", reactor_number, (int)listenfds.size());
 
-    //使用epoll 实现端口复用
-    int epollfd = epoll_create(5);//在内核中创建一块文件描述符内存，参数没有任何含义，大于0即可
-    if (epollfd == -1) {
-        logfile.Write("\tCreate epoll failed\n");
-        exit(-1);
+    //每个事件循环用自己的timerfd处理本循环连接的超时，不再需要SIGALRM和信号管道
+    if (filecache.getNotifyFd() != -1) {
+        baseloop.setNotifyFd(filecache.getNotifyFd());//主循环负责使被修改的缓存文件失效
     }
+    baseloop.setSignalFd(sigfd);
 
-    struct epoll_event events[MAX_EVENT_NUMBER];//创建最大可监听事件数量的数组
-    adfd(epollfd, listenfd, false);//将监听文件描述符添加到epollfd中，内核中的文件描述符区，用于监听
-
-    http_conn::m_epollfd = epollfd;//所有线程共享一个内核事件描述文件描述符
-    
-    //创建管道用于捕捉定时器到时事件
-    res = socketpair(PF_UNIX, SOCK_STREAM, 0, pipefd);
-    assert(res != -1);
-    setNoBlock(pipefd[1]);
-    adfd(epollfd, pipefd[0], false);//将读事件加入epollfd
-
-    //设置信号处理函数
-    addSig(SIGALRM);
-
-    bool timeout = false;//设置定时器到时标志
-    bool have_del = false;
-    alarm(5);//定时5秒后产生SIGALARM信号
-
-    while (true) {//主线程模拟proactor模式，一直监听客户端的介入，并将数据读写完毕后，交给工作线程处理
-        int recnum = epoll_wait(epollfd, events, MAX_EVENT_NUMBER, -1);//阻塞等待
-        if (( recnum < 0 ) && ( errno != EINTR ) ) {//失败,或者因为中断而造成的错误
-            logfile.Write("\there wrong!\n");
-            continue;
+    //监听套接字都准备好以后才接受交接请求，新进程接管以后旧进程的套接字文件被新进程替换
+    int handofffd = -1;
+    if (handoff_path != nullptr) {
+        handofffd = createHandoffListener(handoff_path);
+        if (handofffd == -1) {
+            LOG_ERROR("\tCreate handoff socket %s failed\n", handoff_path);
         }
-        
-        //循环读取出epollfd中返回的监听到变化的文件描述符，并将其内容读取出来
-        for (int i = 0; i < recnum; ++i) {
-            int curfd = events[i].data.fd;//获取当前文件描述符
-
-            /***********说明有客户端接入***************/
-            if (curfd == listenfd) {
-                // printf("Current number of connection: %d\n", http_conn::m_user_count);
-                sockaddr_in caddr;
-                socklen_t len  = sizeof(caddr);
-                int clientfd = accept(curfd, (sockaddr*)&caddr, &len);//接收客户端
-                if (clientfd == -1) {
-                    logfile.Write("\tAccept new connection failed\n");
-                    continue;
-                }
-                //判断当前用户数量
-                if (http_conn::m_user_count >= MAX_FD) {//不能在接入新的连接了
-                    close(curfd);
-                    continue;
-                }
+        else {
+            baseloop.setHandoffFd(handofffd, &listenfds);
+        }
+    }
 
-                logfile.Write("\tNew connection: current client number:%d.  client: %s/%d\n", http_conn::m_user_count, inet_ntoa(caddr.sin_addr), caddr.sin_port);
-                //当前用户数量还没有达到上限，还可以继续加入
-                users[clientfd].initNewConn(clientfd, caddr);
-            }
-            else if (events[i].events & (EPOLLERR | EPOLLHUP | EPOLLRDHUP)) {//客户端已关闭
-                users[curfd].closeConn();//关闭当前通信套接字的连接       
-            }
-            else if ((curfd == pipefd[0]) && (events[i].events & EPOLLIN)) {/****已经到5秒时间，每到5时间就会发送一个信号*****/
-                 //说明有定时器到时了
-                char signals[1024];
-                res = recv(pipefd[0], signals, sizeof(signals), 0);
-                if (res == -1) {
-                    continue;
-                }
-                else if (res == 0) {//客户端断开连接
-                    continue;
-                }
-                else {
-                    for (int i = 0; i < res; ++i) {
-                        if (signals[i] == SIGALRM) {
-                            //用timeout变量标记有定时器任务需要处理，但不立即处理定时器任务
-                            //这是因为定时任务的优先级不高，我们优先处理其他更重要的任务
-                            timeout = true;
-                            break;
-                        }
-                    }
-                }
-            }
-            else if (events[i].events & EPOLLIN) {//检测到读事件
-                if (users[curfd].readRequest()) {//一次性读取所有数据，然后将数据传递给子线程
-                    logfile.Write("\tRead accessed!\n");
-                    threadpool->appendtoPool(users + curfd);
-                }
-                else {//如果读取数据失败了，则要关闭这个连接
-                    logfile.Write("\tRead failed!\n");
-                    users[curfd].closeConn();           
-                }
-            }
-            else if (events[i].events & EPOLLOUT) {//检测到写事件
-                if (!users[curfd].writetoClient()) {   
-                    users[curfd].closeConn();
-                }
-            }
-            //最后处理定时事件，因为I/O事件有更高优先级。当然，这样做将导致定时任务不能按照精准的预定时间执行
-            if (timeout) {//有到期任务
-                deal_timer();
-                //因为一次alarm调用只会引起一次SIGALARM信号，所以我们要重新定时，以不断触发SIGALARM信号
-                alarm(5);
-                timeout = false;
-            }
+    baseloop.loop();//主线程运行主循环，排空完毕后返回
+
+    LOG_INFO("\tEnd1!\n");
+    for (size_t i = 0; i < subloops.size(); ++i) {//子循环同时收到排空通知，等待它们退出
+        subloops[i]->join();
+    }
+    delete threadpool;//等待工作线程处理完手上的请求
+    for (size_t i = 0; i < listenfds.size(); ++i) {
+        close(listenfds[i]);
+    }
+    if (handofffd != -1) {
+        close(handofffd);
+        if (!baseloop.handedOff()) {//交接以后套接字文件属于新进程
+            unlink(handoff_path);
         }
     }
-    logfile.Write("\tEnd1!\n");
-    close(epollfd);
-    close(listenfd);
-    close(pipefd[0]);
-    close(pipefd[1]);
-    logfile.Write("\tEnd2!\n");
-    delete[] users;
-    delete threadpool;
+    close(sigfd);
+    LOG_INFO("\tEnd2!\n");
+    for (size_t i = 0; i < subloops.size(); ++i) {
+        delete subloops[i];
+    }
+    delete users;
+    if (accesslog.isOpen()) {
+        LOG_WARN("\tAccess log dropped %ld records\n", accesslog.dropped());
+        accesslog.close();
+    }
+    logfile.SetSink(nullptr);//其他线程都已经退出，写完缓冲的日志
+    asynclog.stop();
     return 0;
 }
\ No newline at end of file
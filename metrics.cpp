@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include "metrics.h"
+#include "http_conn.h"
+#include "asynclog.h"
+#include "accesslog.h"
+
+extern AsyncLog asynclog;
+extern AccessLog accesslog;
+
+thread_local Metrics::ThreadMetrics* Metrics::t_local = nullptr;
+
+static const char* const s_stage_names[] = {"accept", "read", "queue", "parse", "build", "write"};
+static const int s_response_codes[] = {200, 206, 400, 403, 404, 416, 431, 500, 503};
+
+//统计块只有所属线程写，用普通的加法代替原子读改写，导出线程读到的是某一次写入之后的值
+static inline void add (std::atomic<uint64_t>& counter, uint64_t n) {
+    counter.store(counter.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+/*
+    耗时ns落入的桶，桶的区间是左开右闭的，与Prometheus的le（小于等于）一致
+    以256纳秒为单位，前HIST_SUB个桶每个一个单位，之后每个2的幂区间等分为HIST_SUB个桶
+*/
+static int bucket_of (uint64_t ns) {
+    if (ns == 0) {
+        return 0;
+    }
+    uint64_t v = (ns - 1) >> HIST_UNIT_SHIFT;
+    if (v < HIST_SUB) {
+        return (int)v;
+    }
+    int msb = 63 - __builtin_clzll(v);
+    int index = (msb - HIST_SUB_BITS + 1) * HIST_SUB + (int)((v >> (msb - HIST_SUB_BITS)) & (HIST_SUB - 1));
+    return (index < HIST_BUCKETS - 1) ? index : HIST_BUCKETS - 1;
+}
+
+//第index个桶的上限，单位纳秒
+static uint64_t bucket_upper (int index) {
+    int group = index / HIST_SUB;
+    int sub = index % HIST_SUB;
+    uint64_t upper = (group == 0) ? (uint64_t)(sub + 1) : (uint64_t)(HIST_SUB + sub + 1) << (group - 1);
+    return upper << HIST_UNIT_SHIFT;
+}
+
+static void add_sample (std::string& out, const char* name, uint64_t value) {
+    out += name;
+    out += ' ';
+    out += std::to_string(value);
+    out += '\n';
+}
+
+static void add_header (std::string& out, const char* name, const char* type, const char* help) {
+    out += "# HELP ";
+    out += name;
+    out += ' ';
+    out += help;
+    out += "\n# TYPE ";
+    out += name;
+    out += ' ';
+    out += type;
+    out += '\n';
+}
+
+Metrics::Metrics() : m_enabled(false), m_pool(nullptr), m_threads(nullptr) {}
+
+void Metrics::enable(ThreadPool<http_conn>* pool) {
+    m_pool = pool;
+    for (int i = 0; i < HIST_BUCKETS - 1; ++i) {
+        char buf[32];
+        snprintf(buf, sizeof(buf), "%.9g", bucket_upper(i) / 1e9);
+        m_bounds[i] = buf;
+    }
+    m_bounds[HIST_BUCKETS - 1] = "+Inf";
+    m_enabled = true;
+}
+
+Metrics::ThreadMetrics* Metrics::local() {
+    if (t_local == nullptr) {
+        ThreadMetrics* tm = new ThreadMetrics();//值初始化，所有计数为0
+        tm->next = m_threads.load(std::memory_order_relaxed);
+        while (!m_threads.compare_exchange_weak(tm->next, tm, std::memory_order_release, std::memory_order_relaxed)) {
+        }
+        t_local = tm;
+    }
+    return t_local;
+}
+
+void Metrics::observe(int hist, uint64_t start, uint64_t end) {
+    if (start == 0) {
+        return;
+    }
+    uint64_t ns = (end > start) ? end - start : 0;
+    Histogram& h = local()->hists[hist];
+    add(h.buckets[bucket_of(ns)], 1);
+    add(h.sum, ns);
+}
+
+void Metrics::accepted() {
+    if (m_enabled) {
+        add(local()->accepted, 1);
+    }
+}
+
+void Metrics::responded(int status, uint64_t bytes) {
+    if (!m_enabled) {
+        return;
+    }
+    int slot = RESPONSE_OTHER;
+    for (int i = 0; i < RESPONSE_OTHER; ++i) {
+        if (s_response_codes[i] == status) {
+            slot = i;
+            break;
+        }
+    }
+    ThreadMetrics* tm = local();
+    add(tm->responses[slot], 1);
+    add(tm->bytes_sent, bytes);
+}
+
+//各个桶按Prometheus的要求输出累计值，+Inf桶等于总次数
+void Metrics::render_histogram(std::string& out, const char* name, const char* label, int hist) {
+    uint64_t counts[HIST_BUCKETS] = {0};
+    uint64_t sum = 0;
+    for (ThreadMetrics* tm = m_threads.load(std::memory_order_acquire); tm != nullptr; tm = tm->next) {
+        for (int i = 0; i < HIST_BUCKETS; ++i) {
+            counts[i] += tm->hists[hist].buckets[i].load(std::memory_order_relaxed);
+        }
+        sum += tm->hists[hist].sum.load(std::memory_order_relaxed);
+    }
+    std::string prefix = (label != nullptr) ? std::string("{") + label + "," : std::string("{");
+    std::string suffix = (label != nullptr) ? std::string("{") + label + "} " : std::string(" ");
+    uint64_t total = 0;
+    for (int i = 0; i < HIST_BUCKETS; ++i) {
+        total += counts[i];
+        out += name;
+        out += "_bucket";
+        out += prefix;
+        out += "le=\"";
+        out += m_bounds[i];
+        out += "\"} ";
+        out += std::to_string(total);
+        out += '\n';
+    }
+    char buf[32];
+    snprintf(buf, sizeof(buf), "%.9f", sum / 1e9);
+    out += name;
+    out += "_sum";
+    out += suffix;
+    out += buf;
+    out += '\n';
+    out += name;
+    out += "_count";
+    out += suffix;
+    out += std::to_string(total);
+    out += '\n';
+}
+
+void Metrics::render(std::string& out) {
+    uint64_t accepted = 0;
+    uint64_t bytes_sent = 0;
+    uint64_t responses[RESPONSE_COUNT] = {0};
+    for (ThreadMetrics* tm = m_threads.load(std::memory_order_acquire); tm != nullptr; tm = tm->next) {
+        accepted += tm->accepted.load(std::memory_order_relaxed);
+        bytes_sent += tm->bytes_sent.load(std::memory_order_relaxed);
+        for (int i = 0; i < RESPONSE_COUNT; ++i) {
+            responses[i] += tm->responses[i].load(std::memory_order_relaxed);
+        }
+    }
+
+    add_header(out, "server_connections", "gauge", "Number of open client connections.");
+    add_sample(out, "server_connections", http_conn::m_user_count.load());
+    add_header(out, "server_queue_depth", "gauge", "Requests waiting in the thread pool queue.");
+    add_sample(out, "server_queue_depth", m_pool->get_queue_depth());
+    add_header(out, "server_queue_capacity", "gauge", "Maximum number of requests the thread pool queue can hold.");
+    add_sample(out, "server_queue_capacity", m_pool->get_max_requests());
+    add_header(out, "server_worker_threads", "gauge", "Number of worker threads.");
+    add_sample(out, "server_worker_threads", m_pool->get_thread_number());
+
+    add_header(out, "server_connections_accepted_total", "counter", "Client connections accepted.");
+    add_sample(out, "server_connections_accepted_total", accepted);
+    add_header(out, "server_responses_total", "counter", "Responses sent, by status code.");
+    for (int i = 0; i < RESPONSE_COUNT; ++i) {
+        out += "server_responses_total{code=\"";
+        out += (i == RESPONSE_OTHER) ? std::string("other") : std::to_string(s_response_codes[i]);
+        out += "\"} ";
+        out += std::to_string(responses[i]);
+        out += '\n';
+    }
+    add_header(out, "server_sent_bytes_total", "counter", "Bytes of responses handed to the kernel.");
+    add_sample(out, "server_sent_bytes_total", bytes_sent);
+    add_header(out, "server_log_dropped_lines_total", "counter", "Log lines dropped because the async log buffer was full.");
+    add_sample(out, "server_log_dropped_lines_total", asynclog.dropped());
+    add_header(out, "server_access_log_dropped_records_total", "counter", "Access log records dropped because the buffer was full.");
+    add_sample(out, "server_access_log_dropped_records_total", accesslog.dropped());
+
+    add_header(out, "server_stage_duration_seconds", "histogram", "Time spent in each stage of request processing.");
+    for (int i = 0; i < HIST_REQUEST; ++i) {
+        std::string label = std::string("stage=\"") + s_stage_names[i] + "\"";
+        render_histogram(out, "server_stage_duration_seconds", label.c_str(), i);
+    }
+    add_header(out, "server_request_duration_seconds", "histogram", "Time from the first byte of a request to the last byte of its response.");
+    render_histogram(out, "server_request_duration_seconds", nullptr, HIST_REQUEST);
+}
@@ -0,0 +1,96 @@
+/*
+    本程序实现运行统计，由-m参数开启，通过GET /metrics以Prometheus文本格式导出
+    每个线程第一次记录时得到自己的统计块，只有这个线程写，写入只是普通的加法，不需要加锁和原子读改写；
+    导出时把所有线程的统计块相加，读到的值可能比正在进行的写入稍旧，不影响统计；
+    统计块挂在一个只增加的链表上，线程退出后也不释放，保证计数器只增不减
+    延迟直方图采用HDR的对数线性分桶：每个2的幂区间再等分为HIST_SUB个桶，相对误差不超过1/HIST_SUB；
+    请求依次经过的阶段：
+        accept  接收连接，从调用accept4到把连接交给所属的事件循环
+        read    事件循环读取请求数据
+        queue   在线程池的请求队列中等待
+        parse   工作线程解析请求（process_read）
+        build   工作线程生成响应（process_write）
+        write   从响应生成完毕到最后一个字节交给内核，包括交还事件循环和等待EPOLLOUT的时间
+    另外记录从收到请求第一个字节到响应发送完毕的总延迟
+*/
+#ifndef METRICS_H
+#define METRICS_H
+
+#include <time.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include "threadpool.h"
+
+#define METRICS_PATH "/metrics" // 导出统计的路径
+#define HIST_UNIT_SHIFT 8 // 直方图的最小单位为256纳秒
+#define HIST_SUB_BITS 2 // 每个2的幂区间等分为4个桶
+#define HIST_SUB (1 << HIST_SUB_BITS)
+#define HIST_GROUPS 27 // 2的幂区间个数，最后一个有限桶的上限约为60秒
+#define HIST_BUCKETS (HIST_GROUPS * HIST_SUB) // 最后一个桶存放超过上限的值
+
+class http_conn;
+
+//直方图
+enum METRIC_HIST {HIST_ACCEPT = 0, HIST_READ, HIST_QUEUE, HIST_PARSE, HIST_BUILD, HIST_WRITE, HIST_REQUEST, HIST_COUNT};
+
+//按状态码统计的响应数，其他状态码计入RESPONSE_OTHER
+enum METRIC_RESPONSE {RESPONSE_200 = 0, RESPONSE_206, RESPONSE_400, RESPONSE_403, RESPONSE_404, RESPONSE_416,
+                      RESPONSE_431, RESPONSE_500, RESPONSE_503, RESPONSE_OTHER, RESPONSE_COUNT};
+
+class Metrics {
+public:
+    Metrics();//构造函数
+
+    //开启统计，pool用于导出请求队列的深度，必须在事件循环和工作线程开始处理请求之前调用
+    void enable(ThreadPool<http_conn>* pool);
+    bool enabled() { return m_enabled; }
+
+    //当前时间，单调时钟的纳秒数，没有开启统计时返回0，不读时钟
+    uint64_t clock() {
+        if (!m_enabled) {
+            return 0;
+        }
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+    }
+
+    //记录一次从start到end的耗时，start为0表示开始时没有开启统计，不记录
+    void observe(int hist, uint64_t start, uint64_t end);
+    //接收了一个新连接
+    void accepted();
+    //一个响应结束，bytes为实际发送的字节数
+    void responded(int status, uint64_t bytes);
+
+    //把所有线程的统计按Prometheus文本格式追加到out
+    void render(std::string& out);
+
+private:
+    //一个直方图，buckets[i]是落入第i个桶的次数，sum是所有值的和，单位纳秒
+    struct Histogram {
+        std::atomic<uint64_t> buckets[HIST_BUCKETS];
+        std::atomic<uint64_t> sum;
+    };
+    //一个线程的统计块，按缓存行对齐，避免与其他线程的统计块共享缓存行
+    struct alignas(64) ThreadMetrics {
+        Histogram hists[HIST_COUNT];
+        std::atomic<uint64_t> accepted;
+        std::atomic<uint64_t> responses[RESPONSE_COUNT];
+        std::atomic<uint64_t> bytes_sent;
+        ThreadMetrics* next;
+    };
+
+    ThreadMetrics* local();//当前线程的统计块，第一次调用时创建并挂到链表上
+    void render_histogram(std::string& out, const char* name, const char* label, int hist);
+
+private:
+    bool m_enabled;
+    ThreadPool<http_conn>* m_pool;
+    std::atomic<ThreadMetrics*> m_threads;//所有线程的统计块
+    std::string m_bounds[HIST_BUCKETS];//每个桶的上限，单位秒，已经格式化成le标签的值
+
+    static thread_local ThreadMetrics* t_local;//当前线程的统计块
+};
+
+#endif
@@ -0,0 +1,109 @@
+#include <stdint.h>
+#include "mimetype.h"
+
+#define MIME_SLOTS 256 // 哈希表的槽数，必须是2的幂，约为扩展名个数的5倍时很快就能找到完美哈希的种子
+#define MAX_EXT_LEN 8 // 表中最长的扩展名不超过这个长度，更长的直接按不认识处理
+#define MAX_MIME_SEED 100000 // 编译期最多尝试的种子个数
+
+struct MimeEntry {
+    std::string_view ext;//小写的扩展名，不含点
+    const char* type;
+};
+
+static constexpr MimeEntry s_mimes[] = {
+    //音频
+    {"mp3", "audio/mpeg"}, {"flac", "audio/flac"}, {"ogg", "audio/ogg"}, {"oga", "audio/ogg"},
+    {"opus", "audio/ogg"}, {"m4a", "audio/mp4"}, {"aac", "audio/aac"}, {"wav", "audio/wav"},
+    {"weba", "audio/webm"}, {"mid", "audio/midi"}, {"midi", "audio/midi"}, {"aif", "audio/aiff"},
+    {"aiff", "audio/aiff"},
+    //播放列表和歌词
+    {"m3u", "audio/x-mpegurl"}, {"m3u8", "application/vnd.apple.mpegurl"}, {"pls", "audio/x-scpls"},
+    {"lrc", "text/plain; charset=utf-8"},
+    //图片
+    {"jpg", "image/jpeg"}, {"jpeg", "image/jpeg"}, {"png", "image/png"}, {"gif", "image/gif"},
+    {"webp", "image/webp"}, {"avif", "image/avif"}, {"svg", "image/svg+xml"}, {"ico", "image/x-icon"},
+    {"bmp", "image/bmp"},
+    //网页
+    {"html", "text/html; charset=utf-8"}, {"htm", "text/html; charset=utf-8"}, {"css", "text/css"},
+    {"js", "text/javascript"}, {"mjs", "text/javascript"}, {"json", "application/json"},
+    {"map", "application/json"}, {"xml", "application/xml"}, {"txt", "text/plain; charset=utf-8"},
+    {"wasm", "application/wasm"}, {"woff", "font/woff"}, {"woff2", "font/woff2"}, {"ttf", "font/ttf"},
+    //视频和其他
+    {"mp4", "video/mp4"}, {"webm", "video/webm"}, {"pdf", "application/pdf"}, {"zip", "application/zip"},
+};
+
+static constexpr int MIME_COUNT = sizeof(s_mimes) / sizeof(s_mimes[0]);
+
+//FNV-1a，字母统一转成小写，数字的0x20位本来就是1，不受影响
+static constexpr uint32_t mime_hash(std::string_view ext, uint32_t seed) {
+    uint32_t h = 2166136261u ^ seed;
+    for (size_t i = 0; i < ext.size(); ++i) {
+        h ^= (unsigned char)(ext[i] | 0x20);
+        h *= 16777619u;
+    }
+    return h & (MIME_SLOTS - 1);
+}
+
+struct MimeTable {
+    uint32_t seed;//MAX_MIME_SEED表示没有找到
+    signed char slots[MIME_SLOTS];//s_mimes的下标，-1为空槽
+};
+
+static constexpr MimeTable build_mime_table() {
+    for (uint32_t seed = 0; seed < MAX_MIME_SEED; ++seed) {
+        MimeTable table = {seed, {}};
+        for (int i = 0; i < MIME_SLOTS; ++i) {
+            table.slots[i] = -1;
+        }
+        bool perfect = true;
+        for (int i = 0; i < MIME_COUNT && perfect; ++i) {
+            uint32_t slot = mime_hash(s_mimes[i].ext, seed);
+            if (table.slots[slot] != -1) {//冲突，换下一个种子
+                perfect = false;
+            }
+            table.slots[slot] = i;
+        }
+        if (perfect) {
+            return table;
+        }
+    }
+    return MimeTable{MAX_MIME_SEED, {}};
+}
+
+static constexpr MimeTable s_table = build_mime_table();
+static_assert(s_table.seed != MAX_MIME_SEED, "no perfect hash seed for the MIME table, increase MIME_SLOTS");
+static_assert(MIME_COUNT < 128, "slot index must fit in signed char");
+
+static bool ext_equals(std::string_view ext, std::string_view lower) {
+    if (ext.size() != lower.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < ext.size(); ++i) {
+        char c = ext[i];
+        if (c >= 'A' && c <= 'Z') {
+            c += 'a' - 'A';
+        }
+        if (c != lower[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+const char* lookup_mime_type(std::string_view path) {
+    size_t slash = path.rfind('/');
+    std::string_view name = (slash == std::string_view::npos) ? path : path.substr(slash + 1);
+    size_t dot = name.rfind('.');
+    if (dot == std::string_view::npos) {//没有扩展名，目录名中的点不算
+        return DEFAULT_MIME_TYPE;
+    }
+    std::string_view ext = name.substr(dot + 1);
+    if (ext.empty() || ext.size() > MAX_EXT_LEN) {
+        return DEFAULT_MIME_TYPE;
+    }
+    int idx = s_table.slots[mime_hash(ext, s_table.seed)];
+    if (idx < 0 || !ext_equals(ext, s_mimes[idx].ext)) {
+        return DEFAULT_MIME_TYPE;
+    }
+    return s_mimes[idx].type;
+}
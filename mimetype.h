@@ -0,0 +1,17 @@
+/*
+    本程序实现文件扩展名到MIME类型的查找
+    扩展名表在编译期构造：编译器从0开始尝试哈希种子，直到表中所有扩展名落在不同的槽中，得到完美哈希，
+    运行时查找只计算一次哈希并比较一次字符串；
+    文件缓存打开文件时查找一次，结果保存在缓存项中，同一个文件的后续请求不再查找
+*/
+#ifndef MIMETYPE_H
+#define MIMETYPE_H
+
+#include <string_view>
+
+#define DEFAULT_MIME_TYPE "application/octet-stream" // 没有扩展名或者扩展名不认识时的类型，浏览器按下载处理
+
+//path最后一段的扩展名对应的MIME类型，不区分大小写
+const char* lookup_mime_type(std::string_view path);
+
+#endif
@@ -0,0 +1,110 @@
+#ifndef RINGQUEUE_H
+#define RINGQUEUE_H
+
+/*
+    本程序实现有界的无锁多生产者多消费者队列（Dmitry Vyukov的环形队列算法）
+    每个槽带一个序号，生产者和消费者各自用CAS抢占位置，再用序号交接槽中的数据，
+    入队出队都不需要加锁，也不需要为每个元素分配内存
+*/
+#include <atomic>
+#include <stddef.h>
+#include <stdint.h>
+
+template <typename T>
+class RingQueue {
+
+public:
+    explicit RingQueue (size_t capacity) {//容量向上取整为2的幂
+        size_t size = 2;
+        while (size < capacity) {
+            size <<= 1;
+        }
+        m_mask = size - 1;
+        m_buffer = new Cell[size];
+        for (size_t i = 0; i < size; ++i) {
+            m_buffer[i].seq.store(i, std::memory_order_relaxed);
+        }
+        m_enqueue.store(0, std::memory_order_relaxed);
+        m_dequeue.store(0, std::memory_order_relaxed);
+    }
+
+    ~RingQueue () {
+        delete[] m_buffer;
+    }
+
+    //入队，队列已满时返回false
+    bool push (const T& data) {
+        size_t pos = m_enqueue.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &m_buffer[pos & m_mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)pos;
+            if (diff == 0) {//槽是空的，抢占这个位置
+                if (m_enqueue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            else if (diff < 0) {//槽中的数据还没有被取走，队列已满
+                return false;
+            }
+            else {//被其他生产者抢先，重新读取位置
+                pos = m_enqueue.load(std::memory_order_relaxed);
+            }
+        }
+        cell->data = data;
+        cell->seq.store(pos + 1, std::memory_order_release);//交给消费者
+        return true;
+    }
+
+    //出队，队列为空时返回false
+    bool pop (T& data) {
+        size_t pos = m_dequeue.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &m_buffer[pos & m_mask];
+            size_t seq = cell->seq.load(std::memory_order_acquire);
+            intptr_t diff = (intptr_t)seq - (intptr_t)(pos + 1);
+            if (diff == 0) {//槽中有数据，抢占这个位置
+                if (m_dequeue.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            }
+            else if (diff < 0) {//队列为空
+                return false;
+            }
+            else {
+                pos = m_dequeue.load(std::memory_order_relaxed);
+            }
+        }
+        data = cell->data;
+        cell->seq.store(pos + m_mask + 1, std::memory_order_release);//槽可以被下一圈的生产者使用
+        return true;
+    }
+
+    //队列中元素的大致个数，并发修改时只是一个近似值
+    size_t size () {
+        size_t enqueue = m_enqueue.load(std::memory_order_relaxed);
+        size_t dequeue = m_dequeue.load(std::memory_order_relaxed);
+        return (enqueue > dequeue) ? enqueue - dequeue : 0;
+    }
+
+    size_t capacity () {
+        return m_mask + 1;
+    }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;//等于位置时可以写入，等于位置+1时可以读取
+        T data;
+    };
+
+    Cell* m_buffer;
+    size_t m_mask;
+    //生产者和消费者的位置放在不同的缓存行，避免伪共享
+    alignas(64) std::atomic<size_t> m_enqueue;
+    alignas(64) std::atomic<size_t> m_dequeue;
+
+};
+
+#endif
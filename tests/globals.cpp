@@ -0,0 +1,16 @@
+/*
+    测试程序链接服务器的源文件时需要的全局对象，与main.cpp中的定义一致
+*/
+#include "../_freecplus.h"
+#include "../asynclog.h"
+#include "../accesslog.h"
+#include "../filecache.h"
+#include "../bufpool.h"
+#include "../metrics.h"
+
+CLogFile logfile;//测试中不打开日志文件，分级日志直接丢弃
+AsyncLog asynclog;
+AccessLog accesslog;
+FileCache filecache;
+BufPool bufpool;
+Metrics metrics;
@@ -0,0 +1,23 @@
+/*
+    单元测试用的断言宏
+    失败时打印文件、行号和表达式，继续执行后面的检查，main返回失败个数
+*/
+#ifndef TEST_H
+#define TEST_H
+
+#include <stdio.h>
+
+static int s_failures = 0;
+
+#define CHECK(expr) do { \
+    if (!(expr)) { \
+        fprintf(stderr, "%s:%d: CHECK(%s) failed\n", __FILE__, __LINE__, #expr); \
+        ++s_failures; \
+    } \
+} while (0)
+
+//每个测试程序的main最后调用
+#define TEST_RESULT(name) \
+    (printf("%s: %s\n", name, s_failures == 0 ? "ok" : "FAILED"), s_failures == 0 ? 0 : 1)
+
+#endif
@@ -0,0 +1,41 @@
+/*
+    运行统计直方图分桶的单元测试
+    直接包含metrics.cpp，检查bucket_of和bucket_upper互为边界：桶是左开右闭的，
+    上限本身落在这个桶中，上限加1纳秒落在下一个桶中
+*/
+#include "test.h"
+#include "../metrics.cpp"
+
+int main() {
+    CHECK(bucket_of(0) == 0);
+    CHECK(bucket_of(1) == 0);
+    CHECK(bucket_upper(0) == (1 << HIST_UNIT_SHIFT));
+
+    int misplaced = 0;
+    for (int i = 0; i < HIST_BUCKETS - 1; ++i) {
+        uint64_t upper = bucket_upper(i);
+        if (bucket_of(upper) != i || bucket_of(upper + 1) != i + 1) {
+            if (misplaced++ == 0) {
+                fprintf(stderr, "bucket %d: upper %llu falls in %d, upper + 1 in %d\n",
+                        i, (unsigned long long)upper, bucket_of(upper), bucket_of(upper + 1));
+            }
+        }
+        if (i > 0) {
+            uint64_t lower = bucket_upper(i - 1);
+            CHECK(upper > lower);
+            if (i >= HIST_SUB) {//第一组之后每个桶的宽度不超过下限的1/HIST_SUB
+                CHECK((upper - lower) * HIST_SUB <= lower);
+            }
+        }
+    }
+    CHECK(misplaced == 0);
+
+    //最后一个有限桶的上限约为60秒，超过的值都落在+Inf桶中
+    uint64_t last = bucket_upper(HIST_BUCKETS - 2);
+    CHECK(last > 30000000000ULL && last < 120000000000ULL);
+    CHECK(bucket_of(last + 1) == HIST_BUCKETS - 1);
+    CHECK(bucket_of(3600000000000ULL) == HIST_BUCKETS - 1);
+    CHECK(bucket_of(UINT64_MAX) == HIST_BUCKETS - 1);
+
+    return TEST_RESULT("test_metrics");
+}
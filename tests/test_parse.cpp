@@ -0,0 +1,158 @@
+/*
+    请求可续解析的测试
+    启动一个事件循环和线程池，通过回环TCP连接发送请求，在每一个字节处把请求拆成两次发送，
+    中间等待服务器读完前一部分，回复必须与一次发完整个请求时完全一致（Date头部除外）
+*/
+#include <string>
+#include <stdlib.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <arpa/inet.h>
+#include "test.h"
+#include "../http_conn.h"
+#include "../threadpool.h"
+#include "../eventloop.h"
+#include "../conntable.h"
+#include "../filecache.h"
+
+extern const char* doc_root;
+extern FileCache filecache;
+
+static int s_listenfd = -1;
+static EventLoop* s_loop = nullptr;
+
+//建立一个连接，服务器一端交给事件循环，返回客户端一端
+static int connect_loop() {
+    sockaddr_in addr;
+    socklen_t len = sizeof(addr);
+    getsockname(s_listenfd, (sockaddr*)&addr, &len);
+    int clientfd = socket(AF_INET, SOCK_STREAM, 0);
+    if (connect(clientfd, (sockaddr*)&addr, sizeof(addr)) < 0) {
+        close(clientfd);
+        return -1;
+    }
+    sockaddr_in caddr;
+    len = sizeof(caddr);
+    int connfd = accept4(s_listenfd, (sockaddr*)&caddr, &len, SOCK_NONBLOCK);
+    s_loop->queueConn(connfd, caddr);
+
+    timeval tv = {5, 0};//服务器没有回复时不要一直等下去
+    setsockopt(clientfd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+    return clientfd;
+}
+
+//去掉每秒都会变化的Date头部
+static std::string strip_date(std::string text) {
+    std::string::size_type pos;
+    while ((pos = text.find("\r\nDate: ")) != std::string::npos) {
+        text.erase(pos, text.find("\r\n", pos + 2) - pos);
+    }
+    return text;
+}
+
+//先发送请求的前split个字节，再发送剩余部分，读取回复直到服务器关闭连接
+static std::string exchange(const std::string& request, size_t split) {
+    int fd = connect_loop();
+    if (fd < 0) {
+        return "";
+    }
+    send(fd, request.data(), split, 0);
+    if (split < request.size()) {
+        usleep(2000);//让服务器先读到并解析前一部分
+        send(fd, request.data() + split, request.size() - split, 0);
+    }
+    std::string response;
+    char buf[4096];
+    int n;
+    while ((n = recv(fd, buf, sizeof(buf), 0)) > 0) {
+        response.append(buf, n);
+    }
+    close(fd);
+    return strip_date(response);
+}
+
+static int count_of(const std::string& text, const char* what) {
+    int count = 0;
+    for (std::string::size_type pos = text.find(what); pos != std::string::npos; pos = text.find(what, pos + 1)) {
+        ++count;
+    }
+    return count;
+}
+
+//在每一个位置拆开请求，回复都要与不拆开时一致
+static void check_splits(const char* name, const std::string& request, const std::string& reference) {
+    int mismatches = 0;
+    for (size_t split = 1; split < request.size(); ++split) {
+        if (exchange(request, split) != reference) {
+            if (mismatches++ == 0) {
+                fprintf(stderr, "%s: response differs when split at byte %zu\n", name, split);
+            }
+        }
+    }
+    CHECK(mismatches == 0);
+}
+
+int main() {
+    //在临时目录中准备网站根目录
+    char dir[] = "/tmp/test_parse.XXXXXX";
+    if (mkdtemp(dir) == nullptr) {
+        perror("mkdtemp");
+        return 1;
+    }
+    std::string path = std::string(dir) + "/t.txt";
+    FILE* fp = fopen(path.c_str(), "w");
+    fputs("hello, resumable parser\n", fp);
+    fclose(fp);
+    doc_root = dir;
+
+    s_listenfd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in addr = {};
+    addr.sin_family = AF_INET;
+    addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    addr.sin_port = 0;//由内核分配端口
+    bind(s_listenfd, (sockaddr*)&addr, sizeof(addr));
+    listen(s_listenfd, 16);
+
+    ConnTable users(4096);
+    filecache.init(1024 * 1024);
+    {
+        ThreadPool<http_conn> pool(2, 64);
+        EventLoop loop;
+        CHECK(loop.init(1, &users, &pool));
+        CHECK(loop.startThread());
+        s_loop = &loop;
+
+        //简单的GET请求
+        std::string get = "GET /t.txt HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+        std::string reference = exchange(get, get.size());
+        CHECK(reference.compare(0, 15, "HTTP/1.1 200 OK") == 0);
+        CHECK(count_of(reference, "hello, resumable parser\n") == 1);
+        check_splits("get", get, reference);
+
+        //带请求体的请求，请求体也可能被拆开，服务器只支持GET，请求体收完以后才回复
+        std::string body = "GET /t.txt HTTP/1.1\r\nHost: localhost\r\nContent-Length: 11\r\n"
+                           "Connection: close\r\n\r\nname=value&";
+        reference = exchange(body, body.size());
+        CHECK(reference.compare(0, 15, "HTTP/1.1 200 OK") == 0);
+        check_splits("body", body, reference);
+
+        //流水线请求，拆开的位置可能落在前一个请求中、两个请求之间或者后一个请求中
+        std::string pipelined = "GET /t.txt HTTP/1.1\r\nHost: localhost\r\nConnection: keep-alive\r\n\r\n"
+                                "GET /t.txt HTTP/1.1\r\nHost: localhost\r\nRange: bytes=0-4\r\nConnection: keep-alive\r\n\r\n"
+                                "GET /missing.txt HTTP/1.1\r\nHost: localhost\r\nConnection: close\r\n\r\n";
+        reference = exchange(pipelined, pipelined.size());
+        CHECK(count_of(reference, "HTTP/1.1 200 OK") == 1);
+        CHECK(count_of(reference, "HTTP/1.1 206 ") == 1);
+        CHECK(count_of(reference, "HTTP/1.1 404 ") == 1);
+        check_splits("pipelined", pipelined, reference);
+
+        loop.queueDrain();
+        loop.join();
+    }
+
+    close(s_listenfd);
+    unlink(path.c_str());
+    rmdir(dir);
+    return TEST_RESULT("test_parse");
+}
@@ -0,0 +1,62 @@
+/*
+    Range头部解析的单元测试
+    请求中头部的值后面总是行结束符\r，这里的用例同样以\r结尾，解析时去掉它
+*/
+#include <string>
+#include "test.h"
+#include "../httprange.h"
+
+static int parse(const char* value, off_t size, byte_range* ranges, int max_ranges = 8) {
+    std::string line = std::string(value) + "\r\n";
+    return parse_byte_ranges(std::string_view(line.data(), line.size() - 2), size, ranges, max_ranges);
+}
+
+static bool range_is(const byte_range& r, off_t start, off_t end) {
+    return r.start == start && r.end == end;
+}
+
+int main() {
+    byte_range r[8];
+
+    //单个范围
+    CHECK(parse("bytes=0-499", 1000, r) == 1 && range_is(r[0], 0, 499));
+    CHECK(parse("bytes=500-", 1000, r) == 1 && range_is(r[0], 500, 999));
+    CHECK(parse("bytes=-500", 1000, r) == 1 && range_is(r[0], 500, 999));
+    CHECK(parse("BYTES=0-0", 1000, r) == 1 && range_is(r[0], 0, 0));
+
+    //结束位置和后缀超过文件大小时截断到文件
+    CHECK(parse("bytes=900-5000", 1000, r) == 1 && range_is(r[0], 900, 999));
+    CHECK(parse("bytes=-5000", 1000, r) == 1 && range_is(r[0], 0, 999));
+
+    //多个范围，允许空白
+    CHECK(parse("bytes=0-0,-1", 1000, r) == 2 && range_is(r[0], 0, 0) && range_is(r[1], 999, 999));
+    CHECK(parse("bytes= 0-9 , 20-29 ,\t-5", 1000, r) == 3 && range_is(r[0], 0, 9)
+          && range_is(r[1], 20, 29) && range_is(r[2], 995, 999));
+
+    //无法满足的范围被跳过，全部无法满足时返回-1
+    CHECK(parse("bytes=1000-", 1000, r) == -1);
+    CHECK(parse("bytes=-0", 1000, r) == -1);
+    CHECK(parse("bytes=0-", 0, r) == -1);
+    CHECK(parse("bytes=-1", 0, r) == -1);
+    CHECK(parse("bytes=2000-3000,0-1", 1000, r) == 1 && range_is(r[0], 0, 1));
+
+    //语法错误或者单位不认识时忽略Range
+    CHECK(parse("", 1000, r) == 0);
+    CHECK(parse("bytes=", 1000, r) == 0);
+    CHECK(parse("items=0-1", 1000, r) == 0);
+    CHECK(parse("bytes=abc", 1000, r) == 0);
+    CHECK(parse("bytes=5", 1000, r) == 0);
+    CHECK(parse("bytes=-", 1000, r) == 0);
+    CHECK(parse("bytes=10-5", 1000, r) == 0);
+    CHECK(parse("bytes=0-1;2-3", 1000, r) == 0);
+    CHECK(parse("bytes=0-1,", 1000, r) == 0);
+
+    //范围个数超过上限时忽略Range
+    CHECK(parse("bytes=0-0,1-1,2-2", 1000, r, 3) == 3);
+    CHECK(parse("bytes=0-0,1-1,2-2,3-3", 1000, r, 3) == 0);
+
+    //大文件的偏移不被截断
+    CHECK(parse("bytes=5000000000-", 6000000000LL, r) == 1 && range_is(r[0], 5000000000LL, 5999999999LL));
+
+    return TEST_RESULT("test_range");
+}
@@ -0,0 +1,68 @@
+/*
+    HTTP请求扫描的单元测试
+    直接包含httpscan.cpp，绕过启动时的选择，分别检查每一种扫描实现，CPU不支持的实现跳过
+*/
+#include <stdlib.h>
+#include "test.h"
+#include "../httpscan.cpp"
+
+//在随机缓冲区的每一个起止位置上，各实现的结果都必须与逐字节查找一致
+static void check_scan(const char* name, scan_func func) {
+    char buf[256];
+    int mismatches = 0;
+    srand(1);
+    for (int round = 0; round < 200; ++round) {
+        //字节覆盖0到255，包括最高位为1的字节，行结束符平均每128个字节出现一次
+        for (size_t i = 0; i < sizeof(buf); ++i) {
+            buf[i] = (char)(rand() % 256);
+        }
+        for (size_t begin = 0; begin < 40; ++begin) {
+            for (size_t end = begin; end <= sizeof(buf); end += (end < begin + 80) ? 1 : 7) {
+                if (func(buf + begin, buf + end) != scan_scalar(buf + begin, buf + end)) {
+                    if (mismatches++ == 0) {
+                        fprintf(stderr, "%s: wrong result for [%zu, %zu)\n", name, begin, end);
+                    }
+                }
+            }
+        }
+    }
+    CHECK(mismatches == 0);
+    printf("%s checked\n", name);
+}
+
+int main() {
+    //逐字节查找本身
+    const char line[] = "GET / HTTP/1.1\r\nHost: a\n";
+    CHECK(scan_scalar(line, line + sizeof(line) - 1) == line + 14);
+    CHECK(scan_scalar(line + 15, line + sizeof(line) - 1) == line + 15);
+    CHECK(scan_scalar(line, line + 14) == line + 14);
+    CHECK(scan_scalar(line, line) == line);
+
+#ifdef HTTPSCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        check_scan("avx2", scan_avx2);
+    }
+    if (__builtin_cpu_supports("sse4.2")) {
+        check_scan("sse4.2", scan_sse42);
+    }
+#endif
+    check_scan(scan_impl_name(), scan_line_end);
+
+    //五个已知请求头，不区分大小写
+    CHECK(lookup_header("Connection", 10) == HEADER_CONNECTION);
+    CHECK(lookup_header("CONTENT-LENGTH", 14) == HEADER_CONTENT_LENGTH);
+    CHECK(lookup_header("host", 4) == HEADER_HOST);
+    CHECK(lookup_header("Range", 5) == HEADER_RANGE);
+    CHECK(lookup_header("If-Range", 8) == HEADER_IF_RANGE);
+
+    //落在已知请求头的槽中但名称不同
+    CHECK(lookup_header("hast", 4) == HEADER_UNKNOWN);
+    CHECK(lookup_header("rinse", 5) == HEADER_UNKNOWN);
+    CHECK(lookup_header("Range", 4) == HEADER_UNKNOWN);
+    CHECK(lookup_header("Accept", 6) == HEADER_UNKNOWN);
+    CHECK(lookup_header("User-Agent", 10) == HEADER_UNKNOWN);
+    CHECK(lookup_header("", 0) == HEADER_UNKNOWN);
+
+    return TEST_RESULT("test_scan");
+}
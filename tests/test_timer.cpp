@@ -0,0 +1,135 @@
+/*
+    分层时间轮的单元测试
+    用模拟的时间逐个TIMER_WHEEL_TICK推进时间轮，检查每个定时器都在到期时刻所在的那一次tick中触发，
+    到期时刻覆盖第一层一圈（256个tick）和第二层一圈（16384个tick）的边界，
+    以及第三层一圈的边界，这些定时器要经过一到三次cascade才回到第一层
+*/
+#include <vector>
+#include "test.h"
+#include "../timer_wheel.h"
+
+static const int TICK = TIMER_WHEEL_TICK;
+
+struct fire_record {
+    long long expire;//定时器的到期时刻
+    long long fired;//触发时模拟的当前时间，-1表示还没有触发
+    int count;//触发次数
+};
+
+static long long s_now = 0;//模拟的当前时间
+static int s_fired = 0;//所有定时器触发的总次数
+
+//m_user只是回传给回调的指针，这里借用它指向触发记录
+static void on_expire(http_conn* user) {
+    fire_record* record = (fire_record*)user;
+    record->fired = s_now;
+    ++record->count;
+    ++s_fired;
+}
+
+int main() {
+    timer_wheel wheel;
+    long long start = timer_wheel::now();
+    wheel.tick(start);//时间轮的当前时刻与start对齐
+    long long base = start / TICK + 1;//第一次推进处理的tick
+
+    //到期时刻，单位tick
+    std::vector<long long> ticks;
+    for (long long t : {base, base + 1, base + 255, base + 256, base + 257}) {
+        ticks.push_back(t);
+    }
+    long long lap1 = (base / 256 + 2) * 256;//第一层转完一圈的时刻
+    long long lap2 = (base / 16384 + 2) * 16384;//第二层转完一圈的时刻
+    long long lap3 = (base / (1 << 20) + 1) * (1 << 20);//第三层转完一圈的时刻
+    for (long long lap : {lap1, lap1 + 256, lap2, lap2 + 256, lap2 + 16384, lap3, lap3 + 256, lap3 + 16384}) {
+        for (long long delta = -1; delta <= 1; ++delta) {
+            ticks.push_back(lap + delta);
+        }
+    }
+
+    //最后两个记录：一个已经过期，第一次推进就要触发；一个在推进途中才加入，比时间轮缓存的下一次tick更早到期
+    size_t expired = ticks.size() * 2;
+    size_t late = expired + 1;
+    long long late_add = (lap1 - 100) * TICK;
+    std::vector<fire_record> records(late + 1);
+    std::vector<utill_timer*> timers;
+    for (size_t i = 0; i < records.size(); ++i) {
+        utill_timer* timer = new utill_timer;
+        if (i == expired) {
+            timer->m_expire = start - 1000;
+        }
+        else if (i == late) {
+            timer->m_expire = late_add + 3 * TICK;
+        }
+        else {
+            //偶数的到期时刻正好在tick边界上，奇数的在tick中间，要等到下一个边界
+            timer->m_expire = ticks[i / 2] * TICK - (i % 2) * (TICK / 2);
+        }
+        timer->cb_func = on_expire;
+        timer->m_user = (http_conn*)&records[i];
+        records[i].expire = timer->m_expire;
+        records[i].fired = -1;
+        records[i].count = 0;
+        if (i != late) {
+            wheel.attach_timer(timer);
+        }
+        timers.push_back(timer);
+    }
+
+    //逐个tick推进，next_expire不能晚于下一个触发的时刻，否则事件循环会错过它
+    long long end = (lap3 + 16384 + 2) * TICK;
+    int missed_wakeups = 0;
+    for (s_now = base * TICK; s_now <= end; s_now += TICK) {
+        if (s_now == late_add) {
+            wheel.next_expire();//先让时间轮缓存下一次tick的时刻，再加入更早到期的定时器
+            wheel.attach_timer(timers[late]);
+            CHECK(wheel.next_expire() <= records[late].expire);
+        }
+        long long next = wheel.next_expire();
+        int before = s_fired;
+        wheel.tick(s_now);
+        if (s_fired > before && next > s_now) {
+            if (missed_wakeups++ == 0) {
+                fprintf(stderr, "next_expire %lld is later than a timer fired at %lld\n", next, s_now);
+            }
+        }
+    }
+    CHECK(missed_wakeups == 0);
+
+    for (size_t i = 0; i < records.size(); ++i) {
+        CHECK(records[i].count == 1);
+        if (i == expired) {
+            CHECK(records[i].fired == base * TICK);
+        }
+        else if (records[i].fired < records[i].expire || records[i].fired >= records[i].expire + TICK) {
+            fprintf(stderr, "timer expiring at %lld fired at %lld\n", records[i].expire, records[i].fired);
+            CHECK(false);
+        }
+    }
+    CHECK(wheel.next_expire() == -1);
+
+    for (size_t i = 0; i < timers.size(); ++i) {
+        wheel.detach_timer(timers[i]);//没有触发的定时器还在时间轮中，先摘下再释放
+        delete timers[i];
+    }
+
+    //一次跨过很长时间，中间所有的cascade都要执行，不能漏掉定时器
+    timer_wheel jump;
+    jump.tick(start);
+    fire_record record = {0, -1, 0};
+    utill_timer* timer = new utill_timer;
+    timer->m_expire = lap2 * TICK;
+    timer->cb_func = on_expire;
+    timer->m_user = (http_conn*)&record;
+    jump.attach_timer(timer);
+    s_now = lap2 * TICK - 1;
+    jump.tick(s_now);
+    CHECK(record.count == 0);
+    s_now = lap3 * TICK;
+    jump.tick(s_now);
+    CHECK(record.count == 1);
+    jump.detach_timer(timer);
+    delete timer;
+
+    return TEST_RESULT("test_timer");
+}
@@ -1,39 +1,54 @@
 /*
     本程序是对线程进行封装，形成线程池
-    创建线程，并将其设置分离，系统自动回收资源
+    创建线程，析构时通知所有工作线程退出并等待它们结束，正在处理的请求会先处理完
+    请求队列是有界的无锁环形队列，工作线程先自旋取任务，取不到才用futex休眠，
+    投递任务时只有在有线程休眠时才需要系统调用
+    收件队列窃取模式下每个工作线程有自己的收件队列，不再共享一个队列：
+    事件循环投递的任务轮流放入各个线程的收件队列，工作线程先处理自己收件队列中的任务，
+    为空时从其他线程的收件队列中窃取，突发负载时空闲线程分担繁忙线程的任务
+    工作线程处理完请求后把连接交还给事件循环，自己不会投递后续任务，所以不需要每个线程一个双端队列
 */
 #ifndef THREADPOOL_H
 #define THREADPOOL_H
 
 #include <pthread.h>
-#include <list>
+#include <atomic>
 #include <exception>
-#include "locker.h"
-#include "sem.h"
+#include "ringqueue.h"
+#include "futex.h"
+
+#define WORKER_SPIN 128 // 工作线程取不到任务时自旋的次数，超过后休眠
 
 //线程池封装类
 //定义成模板类，为了代码复用，工作内容可能有很多种，不一定是http请求解析
 template <typename T>
 class ThreadPool {
     public:
-        ThreadPool(int thread_number = 2, int max_requests = 500);//构造函数
+        ThreadPool(int thread_number = 2, int max_requests = 500, bool inbox_stealing = false);//构造函数
         ~ThreadPool();//析构函数
 
         bool appendtoPool(T* request);// 向线程池中增加请求
         int get_thread_number();    // 返回线程池数量
+        int get_max_requests();     // 返回请求队列实际能容纳的请求数量
+        int get_queue_depth();      // 返回请求队列中等待处理的请求数量，并发修改时是近似值
 
     private:
         static void* work(void* arg);
         void run();
+        bool getTask(int self, T*& request);//取一个任务，self为当前工作线程的编号
 
     private:
         int m_thread_number;//线程数量
         pthread_t* m_threads;//描述线程池数组的指针，大小为m_thread_number
-        int m_max_requests;//请求队列中最多允许的、等待请求处理的数量
-        std::list<T*> m_workqueue;//请求队列
-        Locker m_workqueuelocker;//请求队列的锁，由于所有线程共享一个请求队列，必须加锁
-        SEM m_workqueueSem;//请求队列是否有任务需要处理
-        bool m_stop;//是否结束线程
+        int m_max_requests;//请求队列中最多允许的、等待请求处理的数量，构造后为队列的实际容量
+        RingQueue<T*> m_workqueue;//请求队列，所有线程共享，无锁
+        Futex m_futex;//请求队列为空时工作线程在这里休眠
+        std::atomic<int> m_idle;//正在休眠或准备休眠的工作线程数量
+        std::atomic<bool> m_stop;//是否结束线程
+        bool m_steal;//是否为收件队列窃取模式
+        RingQueue<T*>** m_inboxes;//收件队列窃取模式下每个线程的收件队列，大小为m_thread_number，任何线程都可以取
+        std::atomic<int> m_started;//已经启动的工作线程数量，用来分配线程编号
+        std::atomic<unsigned int> m_next;//下一个接收外部任务的收件队列
 };
 
 template<typename T>
@@ -42,50 +57,98 @@ int ThreadPool<T>::get_thread_number(){
 }
 
 template<typename T>
-ThreadPool<T>::ThreadPool(int thread_number, int max_requests) :
-    m_thread_number(thread_number), m_max_requests(max_requests), m_stop(false),
-    m_threads(nullptr) {//构造函数
+int ThreadPool<T>::get_max_requests(){
+    return m_max_requests;
+}
+
+template<typename T>
+int ThreadPool<T>::get_queue_depth(){
+    if (!m_steal) {
+        return m_workqueue.size();
+    }
+    long depth = 0;
+    for (int i = 0; i < m_thread_number; ++i) {
+        depth += m_inboxes[i]->size();
+    }
+    return depth;
+}
+
+template<typename T>
+ThreadPool<T>::ThreadPool(int thread_number, int max_requests, bool inbox_stealing) :
+    m_thread_number(thread_number), m_threads(nullptr), m_max_requests(max_requests),
+    m_workqueue((!inbox_stealing && max_requests > 0) ? max_requests : 1), m_idle(0), m_stop(false),
+    m_steal(inbox_stealing), m_inboxes(nullptr), m_started(0), m_next(0) {//构造函数
     
     if (thread_number <= 0 || max_requests <= 0) {//非法输入
         throw std::exception();
     }
+    if (m_steal) {//请求总数上限平均分给各个线程的收件队列
+        int per_worker = (max_requests + thread_number - 1) / thread_number;
+        m_inboxes = new RingQueue<T*>*[thread_number];
+        for (int i = 0; i < thread_number; ++i) {
+            m_inboxes[i] = new RingQueue<T*>(per_worker);
+        }
+    }
+    //环形队列的容量向上取整为2的幂，实际能放入的请求数可能比max_requests多，
+    //队列深度的水位和导出的队列容量都要按实际容量计算
+    m_max_requests = m_steal ? (int)m_inboxes[0]->capacity() * thread_number : (int)m_workqueue.capacity();
     m_threads = new pthread_t[thread_number];//动态创建线程数组
 
-    //创建线程并使得他们脱离，以让系统自动回收线程资源
+    //创建线程，线程不分离，析构时等待它们结束
     for (int i = 0; i < thread_number; ++i) {
         //std::cout << "正在创建线程：" << i << std::endl;
         int res = pthread_create(m_threads + i, nullptr, work, this);//创建线程
         if (res != 0) {
+            m_stop = true;//让已经创建的线程退出
+            m_futex.wakeAll();
+            for (int j = 0; j < i; ++j) {
+                pthread_join(m_threads[j], nullptr);
+            }
             delete[] m_threads;
-            m_threads = nullptr;
-        }
-
-        res = pthread_detach(m_threads[i]);//设置线程分离，让系统自动回收资源
-        if (res != 0) {
-            delete[] m_threads;
-            m_threads = nullptr;
+            throw std::exception();
         }
     }
 }
 
 template <typename T>
 ThreadPool<T>::~ThreadPool () {//析构函数
+    m_stop = true;//线程结束，停止运行
+    m_futex.wakeAll();//唤醒休眠的线程，让它们看到m_stop
+    for (int i = 0; i < m_thread_number; ++i) {//等待正在处理的请求处理完
+        pthread_join(m_threads[i], nullptr);
+    }
     delete[] m_threads;
     m_threads = nullptr;
-    m_stop = true;//线程结束，停止运行
+    if (m_steal) {//工作线程都已经结束，可以释放各自的队列
+        for (int i = 0; i < m_thread_number; ++i) {
+            delete m_inboxes[i];
+        }
+        delete[] m_inboxes;
+    }
 }
 
 template<typename T>
 bool ThreadPool<T>::appendtoPool (T* request) {//向线程池中增加请求
-    //操作工作队列时候一定加锁
-    m_workqueuelocker.lock();//对工作队列加锁
-    if (m_workqueue.size() > m_max_requests) {//当前已经到达最大请求队列上限，无法在继续
-        m_workqueuelocker.unlock();//解锁
+    if (m_steal) {
+        bool pushed = false;
+        //任务轮流放入各个收件队列，满了就换下一个
+        unsigned int start = m_next.fetch_add(1, std::memory_order_relaxed);
+        for (int i = 0; i < m_thread_number && !pushed; ++i) {
+            pushed = m_inboxes[(start + i) % m_thread_number]->push(request);
+        }
+        if (!pushed) {//所有队列都满了
+            return false;
+        }
+    }
+    else if (!m_workqueue.push(request)) {//当前已经到达最大请求队列上限，无法在继续
         return false;
     }
-    m_workqueue.push_back(request);//将请求加入工作队列
-    m_workqueuelocker.unlock();//解锁
-    m_workqueueSem.post();//工作对象信号量+1
+    //放入任务和读取m_idle之间必须有全屏障：队列的push只是release写，没有屏障时读取可能提前到写入之前，
+    //与工作线程登记空闲后再检查队列交错时，双方都看不到对方，工作线程休眠而任务留在队列中
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+    if (m_idle.load() > 0) {//只有在有线程休眠时才需要唤醒
+        m_futex.wake(1);
+    }
     return true;
 }
 
@@ -96,19 +159,51 @@ void* ThreadPool<T>::work(void* arg) {//子线程所要执行的内容
     return pool;
 }
 
+template<typename T>
+bool ThreadPool<T>::getTask (int self, T*& request) {
+    if (!m_steal) {
+        return m_workqueue.pop(request);
+    }
+    if (m_inboxes[self]->pop(request)) {
+        return true;
+    }
+    for (int i = 1; i < m_thread_number; ++i) {//自己的收件队列为空，从其他线程的收件队列窃取
+        if (m_inboxes[(self + i) % m_thread_number]->pop(request)) {
+            return true;
+        }
+    }
+    return false;
+}
+
 template<typename T>
 void ThreadPool<T>::run () {
+    int self = m_started.fetch_add(1);//本线程的编号
     while (!m_stop) {//一直运行，直到命令线程终止
-        m_workqueueSem.waitSem();//一直阻塞等待有任务进入
-        m_workqueuelocker.lock();//等到有任务了，开始加锁
-        if (m_workqueue.empty()) {//为什么要在此检查呢？
-            m_workqueuelocker.unlock();//解锁
-            continue;
+        T* request = nullptr;
+        bool got = false;
+        for (int i = 0; i < WORKER_SPIN && !got; ++i) {//先自旋，突发请求时不用休眠和唤醒
+            got = getTask(self, request);
+            if (!got) {
+                cpu_relax();
+            }
+        }
+        if (!got) {
+            /*
+                准备休眠：先登记为空闲并读取序号，再检查一次队列和退出标志。
+                如果投递者在检查之后才放入任务，它一定能看到m_idle大于0并调用wake改变序号，
+                此时wait会立即返回，不会丢失唤醒；析构时的wakeAll同理
+            */
+            m_idle.fetch_add(1);
+            int seq = m_futex.prepare();
+            got = getTask(self, request);
+            if (!got && !m_stop) {
+                m_futex.wait(seq);
+            }
+            m_idle.fetch_sub(1);
+            if (!got) {
+                continue;
+            }
         }
-        //如果队列不为空，说明真的存在任务来了
-        T* request = m_workqueue.front();//取出任务
-        m_workqueue.pop_back();//从工作队列中删除任务
-        m_workqueuelocker.unlock();//解锁
         if (!request) {
             continue;
         }
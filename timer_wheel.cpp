@@ -0,0 +1,179 @@
+#include "timer_wheel.h"
+#include "http_conn.h"
+#include "logging.h"
+
+timer_wheel::timer_wheel() {
+    for (int i = 0; i < TVR_SIZE; ++i) {
+        m_tv1[i].m_prev = m_tv1[i].m_next = &m_tv1[i];
+    }
+    for (int level = 0; level < TVN_LEVELS; ++level) {
+        for (int i = 0; i < TVN_SIZE; ++i) {
+            m_tvn[level][i].m_prev = m_tvn[level][i].m_next = &m_tvn[level][i];
+        }
+    }
+    m_current = now() / TIMER_WHEEL_TICK;
+    m_next = -1;
+    m_count = 0;
+}
+
+timer_wheel::~timer_wheel() {
+    for (int i = 0; i < TVR_SIZE; ++i) {
+        while (m_tv1[i].m_next != &m_tv1[i]) {
+            del_timer(m_tv1[i].m_next);
+        }
+    }
+    for (int level = 0; level < TVN_LEVELS; ++level) {
+        for (int i = 0; i < TVN_SIZE; ++i) {
+            while (m_tvn[level][i].m_next != &m_tvn[level][i]) {
+                del_timer(m_tvn[level][i].m_next);
+            }
+        }
+    }
+}
+
+long long timer_wheel::now() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);//不受修改系统时间的影响
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+void timer_wheel::link(utill_timer* head, utill_timer* timer) {
+    ++m_count;
+    timer->m_prev = head->m_prev;
+    timer->m_next = head;
+    head->m_prev->m_next = timer;
+    head->m_prev = timer;
+}
+
+void timer_wheel::unlink(utill_timer* timer) {
+    if (timer->m_prev == nullptr) {//不在时间轮中
+        return;
+    }
+    --m_count;
+    timer->m_prev->m_next = timer->m_next;
+    timer->m_next->m_prev = timer->m_prev;
+    timer->m_prev = nullptr;
+    timer->m_next = nullptr;
+}
+
+/*
+    到期时间距离当前时刻越远，挂到越高的层：
+    第一层直接按到期时刻的低8位选槽，高层按对应的6位选槽，
+    已经过期的定时器挂到当前槽，下一次tick就会处理
+*/
+void timer_wheel::place(utill_timer* timer) {
+    long long expires = (timer->m_expire + TIMER_WHEEL_TICK - 1) / TIMER_WHEEL_TICK;
+    long long idx = expires - m_current;
+    if (idx < 0) {
+        expires = m_current;
+        idx = 0;
+    }
+    if (idx < TVR_SIZE) {
+        link(&m_tv1[expires & (TVR_SIZE - 1)], timer);
+        if (m_next != -1 && expires < m_next) {//比缓存的下一次tick时刻更早
+            m_next = expires;
+        }
+        return;
+    }
+    if (idx > MAX_TICKS) {//超过时间轮能表示的范围，按最长时间处理
+        expires = m_current + MAX_TICKS;
+        idx = MAX_TICKS;
+    }
+    for (int level = 0; level < TVN_LEVELS; ++level) {
+        int shift = TVR_BITS + (level + 1) * TVN_BITS;
+        if (level == TVN_LEVELS - 1 || idx < (1LL << shift)) {
+            int i = (expires >> (shift - TVN_BITS)) & (TVN_SIZE - 1);
+            link(&m_tvn[level][i], timer);
+            return;
+        }
+    }
+}
+
+void timer_wheel::cascade(int level, int index) {
+    utill_timer* head = &m_tvn[level][index];
+    while (head->m_next != head) {
+        utill_timer* timer = head->m_next;
+        unlink(timer);
+        place(timer);
+    }
+}
+
+void timer_wheel::add_timer(utill_timer* timer, int timeout) {
+    if (timer == nullptr) return;//传入的参数为空，无需插入
+    timer->m_expire = now() + timeout;
+    place(timer);
+}
+
+void timer_wheel::adjust_timer(utill_timer* timer, int timeout) {
+    if (timer == nullptr) return;//异常输入
+    unlink(timer);
+    add_timer(timer, timeout);
+}
+
+void timer_wheel::del_timer(utill_timer* timer) {
+    if (timer == nullptr) return;//异常输入
+    unlink(timer);
+    delete timer;
+}
+
+void timer_wheel::detach_timer(utill_timer* timer) {
+    if (timer == nullptr) return;//异常输入
+    unlink(timer);
+}
+
+void timer_wheel::attach_timer(utill_timer* timer) {
+    if (timer == nullptr || timer->m_prev != nullptr) return;//异常输入或者已经在时间轮中
+    place(timer);
+}
+
+/*
+    每次调用时把时间轮从上次的时刻转到当前时刻，
+    第一层转完一圈时从高层取下一个槽的定时器重新分配，然后处理当前槽中所有到期的定时器
+*/
+void timer_wheel::tick(long long now_ms) {
+    long long target = now_ms / TIMER_WHEEL_TICK;
+    while (m_current <= target) {
+        int index = m_current & (TVR_SIZE - 1);
+        if (index == 0) {
+            for (int level = 0; level < TVN_LEVELS; ++level) {
+                int i = (m_current >> (TVR_BITS + level * TVN_BITS)) & (TVN_SIZE - 1);
+                cascade(level, i);
+                if (i != 0) {//这一层还没有转完一圈，不需要再从更高层取
+                    break;
+                }
+            }
+        }
+        ++m_current;//先前进再执行回调，回调中新加的定时器不会挂到正在处理的槽中
+
+        utill_timer* head = &m_tv1[index];
+        while (head->m_next != head) {
+            utill_timer* timer = head->m_next;
+            unlink(timer);
+            //调用定时器的回调函数，执行定时任务，主要是进行资源释放，连接关闭
+            timer->cb_func(timer->m_user);
+            LOG_DEBUG("\tDelete some connections.  current clinent number: %d\n", http_conn::m_user_count.load());
+        }
+    }
+    m_next = -1;
+}
+
+/*
+    找到第一层中从当前时刻开始第一个非空的槽；第一层转完一圈时需要从高层分配定时器，
+    所以最晚在下一圈开始的时刻也要tick一次。结果缓存在m_next中，
+    新加入更早的定时器时在place中更新，删除定时器时不更新，最多多唤醒一次
+*/
+long long timer_wheel::next_expire() {
+    if (m_count == 0) {
+        return -1;
+    }
+    if (m_next == -1) {
+        for (long long t = m_current; ; ++t) {
+            int index = t & (TVR_SIZE - 1);
+            if (index == 0 || m_tv1[index].m_next != &m_tv1[index]) {
+                m_next = t;
+                break;
+            }
+        }
+    }
+    return m_next * TIMER_WHEEL_TICK;
+}
@@ -0,0 +1,59 @@
+/*
+    本程序实现分层时间轮，用来替代按超时时间排序的定时器链表
+    排序链表插入和调整都要遍历链表，每次读数据都要调整定时器，连接数多时成为热点；
+    时间轮把定时器按到期时间挂到对应的槽中，插入、刷新和删除都是O(1)
+    第一层256个槽，每个槽TIMER_WHEEL_TICK毫秒；后面三层各64个槽，每个槽覆盖前一层转一圈的时间，
+    低层转完一圈时把高层下一个槽中的定时器重新分配到低层（cascade），与Linux内核的定时器实现相同
+*/
+#ifndef TIMER_WHEEL_H
+#define TIMER_WHEEL_H
+
+#include "utill_timer.h"
+
+#define TIMER_WHEEL_TICK 10 // 时间轮的精度，单位毫秒
+
+class timer_wheel {
+public:
+    timer_wheel();//构造函数
+    ~timer_wheel();//析构函数，释放还在时间轮中的定时器
+
+    //将目标定时器timer添加到时间轮中，timeout毫秒后到期
+    void add_timer(utill_timer* timer, int timeout);
+    //刷新定时器，timeout毫秒后到期，连接有数据读写时调用
+    void adjust_timer(utill_timer* timer, int timeout);
+    //将目标定时器timer从时间轮中删除并释放
+    void del_timer(utill_timer* timer);
+    //把定时器从时间轮中摘下但不释放，保留原来的到期时刻
+    void detach_timer(utill_timer* timer);
+    //把摘下的定时器按原来的到期时刻放回时间轮，已经过期的在下一次tick时处理
+    void attach_timer(utill_timer* timer);
+    //处理到now_ms（单调时钟，毫秒）为止所有到期的定时器，缺省为当前时间，测试中传入模拟的时间
+    void tick(long long now_ms = now());
+    //下一次需要调用tick的时刻（单调时钟，毫秒），没有定时器时返回-1
+    long long next_expire();
+
+    static long long now();//单调时钟的当前时间，单位毫秒
+
+private:
+    static const int TVR_BITS = 8;
+    static const int TVN_BITS = 6;
+    static const int TVR_SIZE = 1 << TVR_BITS;//第一层槽数
+    static const int TVN_SIZE = 1 << TVN_BITS;//高层槽数
+    static const int TVN_LEVELS = 3;//高层的层数
+    static const long long MAX_TICKS = (1LL << (TVR_BITS + TVN_LEVELS * TVN_BITS)) - 1;//最长的定时时间
+
+    void place(utill_timer* timer);//根据到期时间把定时器挂到对应的槽中
+    void cascade(int level, int index);//把高层一个槽中的定时器重新分配到低层
+    void link(utill_timer* head, utill_timer* timer);//挂到槽的链表尾部
+    void unlink(utill_timer* timer);//从所在的槽中摘下
+
+private:
+    //每个槽是带头节点的双向循环链表，头节点不是真正的定时器
+    utill_timer m_tv1[TVR_SIZE];
+    utill_timer m_tvn[TVN_LEVELS][TVN_SIZE];
+    long long m_current;//时间轮当前转到的时刻，单位TIMER_WHEEL_TICK
+    long long m_next;//缓存的下一次需要tick的时刻，单位TIMER_WHEEL_TICK，-1表示需要重新计算
+    int m_count;//时间轮中定时器的个数
+};
+
+#endif
@@ -0,0 +1,191 @@
+/*
+    二进制访问日志的离线解码工具，把服务器-l参数写出的访问日志转换成CSV或者JSON
+    用法：accesslog_decode [-j] 访问日志文件...
+    缺省输出CSV，第一行是列名；-j输出JSON，每行一个请求；
+    多个文件按给出的顺序解码，路径记录在文件之间共用，切换出的历史文件应按时间顺序放在当前文件之前；
+    压缩过的历史文件（.gz）可以直接解码，不需要先解压
+*/
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <zlib.h>
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include "../accessrecord.h"
+
+//与http_conn::METHOD的顺序一致
+static const char* s_methods[] = {"GET", "POST", "HEAD", "PUT", "DELETE", "TRACE", "OPTIONS", "CONNECT"};
+
+static std::unordered_map<uint64_t, std::string> s_paths;//路径哈希值到路径
+
+static const char* method_name(int method) {
+    if (method >= 0 && method < (int)(sizeof(s_methods) / sizeof(s_methods[0]))) {
+        return s_methods[method];
+    }
+    return "-";
+}
+
+//时间格式为2020-01-01T12:30:25.123456Z
+static void format_time(uint64_t time_us, char* buf, int len) {
+    time_t sec = time_us / 1000000;
+    struct tm tm;
+    gmtime_r(&sec, &tm);
+    int n = strftime(buf, len, "%Y-%m-%dT%H:%M:%S", &tm);
+    snprintf(buf + n, len - n, ".%06uZ", (unsigned)(time_us % 1000000));
+}
+
+//CSV字段中有逗号、引号或者换行时用引号括起来，引号写两次
+static void put_csv(const std::string& text) {
+    if (text.find_first_of(",\"\r\n") == std::string::npos) {
+        fputs(text.c_str(), stdout);
+        return;
+    }
+    putchar('"');
+    for (size_t i = 0; i < text.size(); ++i) {
+        if (text[i] == '"') {
+            putchar('"');
+        }
+        putchar(text[i]);
+    }
+    putchar('"');
+}
+
+static void put_json(const std::string& text) {
+    putchar('"');
+    for (size_t i = 0; i < text.size(); ++i) {
+        unsigned char c = text[i];
+        if (c == '"' || c == '\\') {
+            putchar('\\');
+            putchar(c);
+        }
+        else if (c < 0x20) {
+            printf("\\u%04x", c);
+        }
+        else {
+            putchar(c);
+        }
+    }
+    putchar('"');
+}
+
+static void print_request(const access_request_record* req, bool json) {
+    char when[64];
+    format_time(req->time_us, when, sizeof(when));
+    char addr[INET_ADDRSTRLEN];
+    struct in_addr in;
+    in.s_addr = req->addr;
+    inet_ntop(AF_INET, &in, addr, sizeof(addr));
+
+    std::string path;
+    if (req->path_id != 0) {
+        std::unordered_map<uint64_t, std::string>::iterator it = s_paths.find(req->path_id);
+        if (it != s_paths.end()) {
+            path = it->second;
+        }
+        else {//路径记录在更早的文件中，没有一起解码
+            char id[32];
+            snprintf(id, sizeof(id), "#%016llx", (unsigned long long)req->path_id);
+            path = id;
+        }
+    }
+
+    if (json) {
+        printf("{\"time\":\"%s\",\"client\":\"%s:%u\",\"method\":\"%s\",\"path\":", when, addr, req->port, method_name(req->method));
+        put_json(path);
+        printf(",\"status\":%u,\"bytes\":%llu,\"latency_us\":%u}\n", req->status, (unsigned long long)req->bytes, req->latency_us);
+    }
+    else {
+        printf("%s,%s:%u,%s,", when, addr, req->port, method_name(req->method));
+        put_csv(path);
+        printf(",%u,%llu,%u\n", req->status, (unsigned long long)req->bytes, req->latency_us);
+    }
+}
+
+//解码一个文件，格式错误时返回false
+//gzread读取没有压缩的文件时直接返回原始内容，当前文件和压缩过的历史文件用同一种方式读取
+static bool decode(const char* filename, bool json) {
+    gzFile fp = gzopen(filename, "rb");
+    if (fp == nullptr) {
+        fprintf(stderr, "open %s failed\n", filename);
+        return false;
+    }
+    std::vector<char> data;
+    char buf[65536];
+    int n = 0;
+    while ((n = gzread(fp, buf, sizeof(buf))) > 0) {
+        data.insert(data.end(), buf, buf + n);
+    }
+    int err = gzclose(fp);//压缩文件不完整时gzread只是读到结尾，gzclose返回Z_BUF_ERROR
+    if (n < 0 || err != Z_OK) {//压缩数据损坏或者不完整
+        fprintf(stderr, "read %s failed\n", filename);
+        return false;
+    }
+
+    const access_file_record* header = (const access_file_record*)data.data();
+    if (data.size() < sizeof(access_file_record) || header->type != ACCESS_RECORD_FILE
+        || header->magic != ACCESS_LOG_MAGIC) {
+        fprintf(stderr, "%s is not an access log\n", filename);
+        return false;
+    }
+    if (header->version != ACCESS_LOG_VERSION) {
+        fprintf(stderr, "%s: unsupported version %u\n", filename, header->version);
+        return false;
+    }
+
+    size_t pos = header->size;
+    while (pos + 4 <= data.size()) {
+        uint16_t type = 0;
+        uint16_t size = 0;
+        memcpy(&type, &data[pos], 2);
+        memcpy(&size, &data[pos + 2], 2);
+        if (size < 8 || size % 8 != 0) {
+            fprintf(stderr, "%s: bad record at offset %zu\n", filename, pos);
+            return false;
+        }
+        if (pos + size > data.size()) {//服务器正在写入的最后一条记录，还不完整
+            break;
+        }
+        const char* rec = &data[pos];
+        if (type == ACCESS_RECORD_PATH && size >= sizeof(access_path_record)) {
+            access_path_record path;
+            memcpy(&path, rec, sizeof(path));
+            if (sizeof(path) + path.len <= size) {
+                s_paths[path.path_id].assign(rec + sizeof(path), path.len);
+            }
+        }
+        else if (type == ACCESS_RECORD_REQUEST && size >= sizeof(access_request_record)) {
+            access_request_record req;
+            memcpy(&req, rec, sizeof(req));
+            print_request(&req, json);
+        }
+        pos += size;//不认识的记录按长度跳过
+    }
+    return true;
+}
+
+int main(int argc, char* argv[]) {
+    bool json = false;
+    int opt = 0;
+    while ((opt = getopt(argc, argv, "j")) != -1) {
+        if (opt == 'j') {
+            json = true;
+        }
+    }
+    if (optind >= argc) {
+        fprintf(stderr, "Format：./accesslog_decode [-j] 访问日志文件...\nSample: ./accesslog_decode /tmp/access.log.20200101123025 /tmp/access.log > access.csv\n");
+        return 1;
+    }
+    if (!json) {
+        printf("time,client,method,path,status,bytes,latency_us\n");
+    }
+    int ret = 0;
+    for (int i = optind; i < argc; ++i) {
+        if (!decode(argv[i], json)) {
+            ret = 1;
+        }
+    }
+    return ret;
+}
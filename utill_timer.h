@@ -2,16 +2,18 @@
 #define UTILL_TIMER_H
 #include <time.h>
 
-//定时器类
+class http_conn;
+
+//定时器类，由时间轮管理
 class utill_timer {
 public:
-    utill_timer():m_prev(nullptr), m_next(nullptr){}
+    utill_timer():m_expire(0), cb_func(nullptr), m_user(nullptr), m_prev(nullptr), m_next(nullptr){}
 public:
     //成员变量
-    time_t m_expire;//任务超时时间，这里使用绝对时间
-    void (*cb_func)(int);//任务回调函数，回调函数处理客户端数据，由定时器执行者传递给回调函数
-    int m_user_sockfd;//用户数据结构，包括客户端socket\文件描述符等
-    utill_timer* m_prev;//指向前一个定时器
-    utill_timer* m_next;//指向后一个定时器
+    long long m_expire;//任务超时时间，这里使用单调时钟的绝对时间，单位毫秒
+    void (*cb_func)(http_conn*);//任务回调函数，回调函数处理客户端数据，由定时器执行者传递给回调函数，回调函数负责调用del_timer释放定时器
+    http_conn* m_user;//定时器所属的连接
+    utill_timer* m_prev;//指向时间轮槽中的前一个定时器，为空表示不在时间轮中
+    utill_timer* m_next;//指向时间轮槽中的后一个定时器
 };
-#endif
\ No newline at end of file
+#endif